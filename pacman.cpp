@@ -2,1503 +2,7576 @@
 #include <SDL.h>
 #include <SDL_image.h>
 #include <stdio.h>
-#include <string>
-#include <stdlib.h>
-
-//declare classes
-class Player;
-class Tile;
-class Board;
-class LTexture;
-
-//Direction constants
-enum Directions
-{
-    RIGHT,
-    LEFT,
-    UP,
-    DOWN,
-    DEFAULT
+#include <string>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <vector>
+#include <algorithm>
+#include <deque>
+#include <thread>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <type_traits>
+#include <atomic>
+#include <new>
+#include <signal.h>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define PACMAN_SSE2 1
+#endif
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define PACMAN_MMAP 1
+#endif
+
+//Frame profiler scopes, build with -DPACMAN_PROFILE=0 to compile them out
+#ifndef PACMAN_PROFILE
+#define PACMAN_PROFILE 1
+#endif
+
+//Heap allocation counts in the benchmarks, build with -DPACMAN_COUNT_ALLOCATIONS=1 to replace the global operator new
+#ifndef PACMAN_COUNT_ALLOCATIONS
+#define PACMAN_COUNT_ALLOCATIONS 0
+#endif
+
+//declare classes
+class Player;
+class Tile;
+class Board;
+class LTexture;
+class World;
+class Game;
+
+//Direction constants
+enum Directions
+{
+    RIGHT,
+    LEFT,
+    UP,
+    DOWN,
+    DEFAULT
+};
+
+//Ghost targeting modes
+enum GhostAI
+{
+    //one step Manhattan heuristic, as in the arcade
+    ARCADE_AI,
+
+    //true shortest paths from the path table
+    PATH_AI
 };
 
 //Screen dimension constants
 const int SCREEN_WIDTH = 224;
-const int SCREEN_HEIGHT = 248;
-
-//Player class
-class Entity
-{
-    public:
-        //initializes variables
-        Entity();
-
-        //Deallocates entity
-        ~Entity();
-
-        //Frees memory
-        void free();
-
-        //gets coordinates and direction
-        int getXLoc();
-        int getYLoc();
-        int getOrientation();
-
-        //gets correct sprite
-        int currentSprite();
-
-        //sets coordinates and direction
-        void setYLoc(int y);
-        void setXLoc(int x);
-        void setOrientation(int dir);
-
-        //checks if mouth is open or closed
-        bool getMouthOpen();
-
-        //opens or closes mouth
-        void setMouthOpen(bool b);
-
-        //sets next turn
-        void setNextTurn(int turn);
-
-        //updates location
-        void update(Board b);
-
-        //where entity will try to turn
-        int nextTurn;
-
-        //activate/deactivate scatter mode
-        void setScatter(bool b)
-        {
-            scatterMode = b;
-        }
-
-        //sets fleeMode
-        void setFlee(bool b)
-        {
-            fleeMode = b;
-        }
-
-        //retrieve scatterMode
-        bool getScatter()
-        {
-            return scatterMode;
-        }
-
-        //retrieves fleeMode
-        bool getFlee()
-        {
-            return fleeMode;
-        }
-
-        //returns if two entities share tile
-        bool sharingTile(Entity e)
-        {
-            return (xLoc - 4) / 8 == (e.xLoc - 4) / 8 && (yLoc - 4) / 8 == (e.yLoc - 4) / 8;
-        }
-
-        //sets if ghost is eaten
-        void setEaten(bool b)
-        {
-            eaten = b;
-        }
-
-        //retrieves if ghost is eaten
-        bool getEaten()
-        {
-            return eaten;
-        }
-
-
-    private:
-        //coordinates and direction of movement
-        int xLoc;
-        int yLoc;
-        int orientation;
-
-        //mouth open or closed
-        bool mouthOpen;
-
-        //scatter mode activated
-        bool scatterMode;
-
-        //flee mode activated
-        bool fleeMode;
-
-        //if ghost has been eaten
-        bool eaten;
-};
-
-class Player : public Entity
-{
-    public:
-        //initializes variables
-        Player()
-        {
-            //Sets player at starting point and direction
-            setXLoc(15);
-            setYLoc(13);
-            setOrientation(RIGHT);
-            setNextTurn(DEFAULT);
-            death = 0;
-        }
-
-        int getDeathState()
-        {
-            return death;
-        }
-
-        //kills player
-        void kill()
-        {
-            if (death < 11)
-            {
-                death++;
-            }
-        }
-    private:
-        //records if player is dead or dying
-        int death;
-};
-
-//the red ghost
-class Blinky : public Entity
-{
-    public:
-        Blinky();
-        void decideTurn(Board b, Player p);
-};
-
-//the pink ghost
-class Pinky : public Entity
-{
-    public:
-        Pinky();
-        void decideTurn(Board b, Player p);
-};
-
-//the blue ghost
-class Inky : public Entity
-{
-    public:
-        Inky();
-        void decideTurn(Board board, Player p, Blinky b);
-};
-
-//the blue ghost
-class Clyde : public Entity
-{
-    public:
-        Clyde();
-        void decideTurn(Board b, Player p);
-};
-
-
-//board tile class
-class Tile
-{
-    public:
-        //initializes variables
-        Tile();
-
-        //check if tile has been crossed
-        bool getCrossed();
-
-        //crosses of tile
-        void crossOff();
-
-        //check if player can move in each direction
-        bool canGoUp();
-        bool canGoDown();
-        bool canGoLeft();
-        bool canGoRight();
-
-        //sets directions player can move in
-        void setGoDown(bool b);
-        void setGoUp(bool b);
-        void setGoLeft(bool b);
-        void setGoRight(bool b);
-
-    private:
-        //keeps track if tile has been crossed
-        bool hasCrossed;
-
-        //keeps track of entrances/exits
-        bool goUp;
-        bool goDown;
-        bool goLeft;
-        bool goRight;
-};
-
-//Game board class
-class Board
-{
-    public:
-        //initializes variables
-        Board();
-
-        //updates board
-        void updateBoard(Player player);
-
-        //grabs tile
-        Tile getTile(int i, int j);
-
-    private:
-        //keeps track of tiles player has been on
-        Tile tiles[31][28];
-};
+const int SCREEN_HEIGHT = 248;
 
-//Texture wrapper class
-class LTexture
-{
-	public:
-		//Initializes variables
-		LTexture();
+//Simulation rate, the original game ran one step per 60 Hz vsync
+const int TICKS_PER_SECOND = 60;
 
-		//Deallocates memory
-		~LTexture();
+//Board dimension constants
+const int BOARD_ROWS = 31;
+const int BOARD_COLUMNS = 28;
+const int BOARD_TILES = BOARD_ROWS * BOARD_COLUMNS;
+const int BOARD_WORDS = (BOARD_TILES + 63) / 64;
 
-		//Loads image at specified path
-		bool loadFromFile( std::string path );
+//counts set bits in a 64 bit word
+inline int popcount64(uint64_t x)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcountll(x);
+#else
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (int)((x * 0x0101010101010101ULL) >> 56);
+#endif
+}
 
-		//Deallocates texture
-		void free();
+//index of the lowest set bit, x must not be 0
+inline int lowestBit64(uint64_t x)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(x);
+#else
+    return popcount64((x & (0 - x)) - 1);
+#endif
+}
 
-		//Renders texture at given point
-		void render( int x, int y, SDL_Rect* clip = NULL );
+//index of the highest set bit, x must not be 0
+inline int highestBit64(uint64_t x)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return 63 - __builtin_clzll(x);
+#else
+    int bit = 0;
+    while (x >>= 1)
+    {
+        bit++;
+    }
+    return bit;
+#endif
+}
 
-		//Gets image dimensions
-		int getWidth();
-		int getHeight();
+//maze layout, '#' is wall and '.' is path
+//a path on the left or right edge wraps around to the other side
+constexpr char MAZE_LAYOUT[BOARD_ROWS][BOARD_COLUMNS + 1] =
+{
+    "############################",
+    "#............##............#",
+    "#.####.#####.##.#####.####.#",
+    "#.####.#####.##.#####.####.#",
+    "#.####.#####.##.#####.####.#",
+    "#..........................#",
+    "#.####.##.########.##.####.#",
+    "#.####.##.########.##.####.#",
+    "#......##....##....##......#",
+    "######.#####.##.#####.######",
+    "######.#####.##.#####.######",
+    "######.##..........##.######",
+    "######.##.########.##.######",
+    "######.##.########.##.######",
+    "..........########..........",
+    "######.##.########.##.######",
+    "######.##.########.##.######",
+    "######.##..........##.######",
+    "######.##.########.##.######",
+    "######.##.########.##.######",
+    "#............##............#",
+    "#.####.#####.##.#####.####.#",
+    "#.####.#####.##.#####.####.#",
+    "#...##................##...#",
+    "###.##.##.########.##.##.###",
+    "###.##.##.########.##.##.###",
+    "#......##....##....##......#",
+    "#.##########.##.##########.#",
+    "#.##########.##.##########.#",
+    "#..........................#",
+    "############################"
+};
 
-	private:
-		//The actual hardware texture
-		SDL_Texture* mTexture;
+//exit masks and walkable bits derived from a layout
+struct MazeTopology
+{
+    //two 4 bit exit masks per byte, bit (1 << direction) set if entities can leave that way
+    uint8_t exits[BOARD_TILES / 2];
 
-		//Image dimensions
-		int mWidth;
-		int mHeight;
+    //tiles with at least one exit
+    uint64_t walkable[BOARD_WORDS];
 };
 
-//Starts up SDL and creates window
-bool init();
+constexpr bool mazePath(const char (*layout)[BOARD_COLUMNS + 1], int i, int j)
+{
+    return i >= 0 && i < BOARD_ROWS && layout[i][(j + BOARD_COLUMNS) % BOARD_COLUMNS] == '.';
+}
 
-//Loads media
-bool loadMedia();
+//exits of a tile are simply the neighbouring paths
+constexpr int mazeExits(const char (*layout)[BOARD_COLUMNS + 1], int i, int j)
+{
+    if (!mazePath(layout, i, j))
+    {
+        return 0;
+    }
+    return (mazePath(layout, i, j + 1) << 0) | (mazePath(layout, i, j - 1) << 1)
+         | (mazePath(layout, i - 1, j) << 2) | (mazePath(layout, i + 1, j) << 3);
+}
 
-//Frees media and shuts down SDL
-void close();
+constexpr MazeTopology buildMaze(const char (*layout)[BOARD_COLUMNS + 1])
+{
+    MazeTopology maze = {};
+    for (int i = 0; i < BOARD_ROWS; i++)
+    {
+        for (int j = 0; j < BOARD_COLUMNS; j++)
+        {
+            int index = i * BOARD_COLUMNS + j;
+            int exits = mazeExits(layout, i, j);
+            maze.exits[index >> 1] |= (uint8_t)(exits << ((index & 1) << 2));
+            if (exits)
+            {
+                maze.walkable[index >> 6] |= (uint64_t)1 << (index & 63);
+            }
+        }
+    }
+    return maze;
+}
 
-//The window we'll be rendering to
-SDL_Window* gWindow = NULL;
+//the shipped maze, built by the compiler
+constexpr MazeTopology MAZE = buildMaze(MAZE_LAYOUT);
 
-//The window renderer
-SDL_Renderer* gRenderer = NULL;
+constexpr int mazeExits(const MazeTopology& maze, int i, int j)
+{
+    int index = i * BOARD_COLUMNS + ((j + BOARD_COLUMNS) % BOARD_COLUMNS);
+    return (maze.exits[index >> 1] >> ((index & 1) << 2)) & 15;
+}
 
-//Scene sprites
-SDL_Rect gBoard;
-SDL_Rect gPlayer[8];
-SDL_Rect gBoardPieces[31][28];
-SDL_Rect gBoardPiecesAlt[31][28];
-SDL_Rect gBlinky[8];
-SDL_Rect gPinky[8];
-SDL_Rect gInky[8];
-SDL_Rect gClyde[8];
-SDL_Rect gMiscGhost[8];
-SDL_Rect gPlayerDeath[12];
-LTexture gSpriteSheetTexture;
-
-Tile::Tile()
-{
-    hasCrossed = false;
-    goUp = false;
-    goDown = false;
-    goLeft = false;
-    goRight = false;
-}
-
-void Tile::setGoDown(bool b)
-{
-    goDown = b;
-}
-
-void Tile::setGoUp(bool b)
-{
-    goUp = b;
-}
-
-void Tile::setGoLeft(bool b)
-{
-    goLeft = b;
-}
-
-void Tile::setGoRight(bool b)
-{
-    goRight = b;
-}
-
-bool Tile::canGoDown()
-{
-    return goDown;
-}
-
-bool Tile::canGoUp()
-{
-    return goUp;
-}
-
-bool Tile::canGoLeft()
-{
-    return goLeft;
-}
-
-bool Tile::canGoRight()
-{
-    return goRight;
-}
-
-bool Tile::getCrossed()
-{
-    return hasCrossed;
-}
-
-void Tile::crossOff()
-{
-    hasCrossed = true;
+//every row is exactly BOARD_COLUMNS of '#' and '.', and no path is cut off
+constexpr bool mazeWellFormed(const char (*layout)[BOARD_COLUMNS + 1])
+{
+    for (int i = 0; i < BOARD_ROWS; i++)
+    {
+        for (int j = 0; j < BOARD_COLUMNS; j++)
+        {
+            if (layout[i][j] != '#' && layout[i][j] != '.')
+            {
+                return false;
+            }
+            if (layout[i][j] == '.' && mazeExits(layout, i, j) == 0)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
 }
 
-LTexture::LTexture()
+//every exit has a matching entrance on the other side
+constexpr bool mazeSymmetric(const MazeTopology& maze)
 {
-	//Initialize
-	mTexture = NULL;
-	mWidth = 0;
-	mHeight = 0;
+    for (int i = 0; i < BOARD_ROWS; i++)
+    {
+        for (int j = 0; j < BOARD_COLUMNS; j++)
+        {
+            int exits = mazeExits(maze, i, j);
+            if (((exits >> RIGHT) & 1) != ((mazeExits(maze, i, j + 1) >> LEFT) & 1))
+            {
+                return false;
+            }
+            if (i + 1 < BOARD_ROWS && ((exits >> DOWN) & 1) != ((mazeExits(maze, i + 1, j) >> UP) & 1))
+            {
+                return false;
+            }
+            if ((i == 0 && ((exits >> UP) & 1)) || (i == BOARD_ROWS - 1 && ((exits >> DOWN) & 1)))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
 }
 
-LTexture::~LTexture()
+//FNV-1a over every tile's exit mask in row order
+constexpr uint64_t mazeHash(const MazeTopology& maze)
 {
-	//Deallocate
-	free();
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (int i = 0; i < BOARD_ROWS; i++)
+    {
+        for (int j = 0; j < BOARD_COLUMNS; j++)
+        {
+            hash = (hash ^ (uint64_t)mazeExits(maze, i, j)) * 0x100000001b3ULL;
+        }
+    }
+    return hash;
 }
 
-bool LTexture::loadFromFile( std::string path )
+static_assert(mazeWellFormed(MAZE_LAYOUT), "maze layout may only contain '#' and '.', with no isolated paths");
+static_assert(mazeSymmetric(MAZE), "maze has a one-way exit");
+
+//hash of the exit masks the original hand-written Board constructor produced
+static_assert(mazeHash(MAZE) == 0x6db818ab0fffdac1ULL, "maze adjacency differs from the original board");
+
+//Per entity flags of an EntityStore or EntityState
+enum EntityFlags
 {
-	//Get rid of preexisting texture
-	free();
+    MOUTH_OPEN = 1,
+    SCATTER = 2,
+    FLEE = 4,
+    EATEN = 8
+};
 
-	//The final texture
-	SDL_Texture* newTexture = NULL;
+//Everything about one entity, packed into 8 bytes
+struct EntityState
+{
+    int16_t xLoc;
+    int16_t yLoc;
+    int8_t orientation;
+    int8_t nextTurn;
+    uint8_t flags;
 
-	//Load image at specified path
-	SDL_Surface* loadedSurface = IMG_Load( path.c_str() );
-	if( loadedSurface == NULL )
-	{
-		printf( "Unable to load image %s! SDL_image Error: %s\n", path.c_str(), IMG_GetError() );
-	}
-	else
-	{
-		//Color key image
-		SDL_SetColorKey( loadedSurface, SDL_TRUE, SDL_MapRGB( loadedSurface->format, 0, 0, 0 ) );
+    //player death animation frame, 0 for ghosts
+    uint8_t death;
+};
 
-		//Create texture from surface pixels
-        newTexture = SDL_CreateTextureFromSurface( gRenderer, loadedSurface );
-		if( newTexture == NULL )
-		{
-			printf( "Unable to create texture from %s! SDL Error: %s\n", path.c_str(), SDL_GetError() );
-		}
-		else
-		{
-			//Get image dimensions
-			mWidth = loadedSurface->w;
-			mHeight = loadedSurface->h;
-		}
+//Everything a Game needs to carry on exactly where it was
+//plain bytes, so it can be copied, compared and written out as is
+struct GameState
+{
+    //crossed tiles, one bit each
+    uint64_t crossed[BOARD_WORDS];
 
-		//Get rid of old loaded surface
-		SDL_FreeSurface( loadedSurface );
-	}
+    //player, blinky, pinky, inky
+    EntityState entities[4];
+
+    int32_t frame;
+    int32_t fleeFrame;
+    int16_t crossedTile;
+    uint8_t ghostAI;
+
+    //always zero, spelled out so no byte is left uninitialized
+    uint8_t reserved[5];
+};
+
+static_assert(std::is_trivially_copyable<GameState>::value && std::is_standard_layout<GameState>::value, "GameState must stay plain bytes");
+static_assert(sizeof(EntityState) == 8 && sizeof(GameState) == 160, "GameState has padding the fields don't account for");
+static_assert(sizeof(GameState) <= 256, "GameState should fit in four cache lines");
+static_assert(sizeof(GameState) % 8 == 0 && sizeof(GameState) / 8 <= 32, "rewind deltas work in 64-bit words with a 32-bit mask");
+
+//Player class
+class Entity
+{
+    public:
+        //initializes variables
+        Entity();
+
+        //Deallocates entity
+        ~Entity();
+
+        //Frees memory
+        void free();
+
+        //gets coordinates and direction
+        int getXLoc() const;
+        int getYLoc() const;
+        int getOrientation() const;
+
+        //gets correct sprite
+        int currentSprite() const;
+
+        //sets coordinates and direction
+        void setYLoc(int y);
+        void setXLoc(int x);
+        void setOrientation(int dir);
+
+        //checks if mouth is open or closed
+        bool getMouthOpen() const;
+
+        //opens or closes mouth
+        void setMouthOpen(bool b);
+
+        //sets next turn
+        void setNextTurn(int turn);
+
+        //updates location
+        void update(const World& world);
+
+        //where entity will try to turn
+        int nextTurn;
+
+        //activate/deactivate scatter mode
+        void setScatter(bool b)
+        {
+            scatterMode = b;
+        }
+
+        //sets fleeMode
+        void setFlee(bool b)
+        {
+            fleeMode = b;
+        }
+
+        //retrieve scatterMode
+        bool getScatter() const
+        {
+            return scatterMode;
+        }
+
+        //retrieves fleeMode
+        bool getFlee() const
+        {
+            return fleeMode;
+        }
+
+        //returns if two entities share tile
+        bool sharingTile(const Entity& e) const
+        {
+            return (xLoc - 4) / 8 == (e.xLoc - 4) / 8 && (yLoc - 4) / 8 == (e.yLoc - 4) / 8;
+        }
+
+        //sets if ghost is eaten
+        void setEaten(bool b)
+        {
+            eaten = b;
+        }
+
+        //retrieves if ghost is eaten
+        bool getEaten() const
+        {
+            return eaten;
+        }
+
+        //copies everything but death into state, or back out of it
+        void capture(EntityState& state) const;
+        void restore(const EntityState& state);
+
+
+    private:
+        //coordinates and direction of movement
+        int xLoc;
+        int yLoc;
+        int orientation;
+
+        //mouth open or closed
+        bool mouthOpen;
+
+        //scatter mode activated
+        bool scatterMode;
+
+        //flee mode activated
+        bool fleeMode;
+
+        //if ghost has been eaten
+        bool eaten;
+};
+
+class Player : public Entity
+{
+    public:
+        //initializes variables
+        Player()
+        {
+            //Sets player at starting point and direction
+            setXLoc(15);
+            setYLoc(13);
+            setOrientation(RIGHT);
+            setNextTurn(DEFAULT);
+            death = 0;
+        }
+
+        int getDeathState() const
+        {
+            return death;
+        }
+
+        //sets how far into dying the player is, for restoring snapshots
+        void setDeathState(int d)
+        {
+            death = d;
+        }
+
+        //kills player
+        void kill()
+        {
+            if (death < 11)
+            {
+                death++;
+            }
+        }
+    private:
+        //records if player is dead or dying
+        int death;
+};
+
+//the red ghost
+class Blinky : public Entity
+{
+    public:
+        Blinky();
+        void decideTurn(const World& world);
+};
+
+//the pink ghost
+class Pinky : public Entity
+{
+    public:
+        Pinky();
+        void decideTurn(const World& world);
+};
+
+//the blue ghost
+class Inky : public Entity
+{
+    public:
+        Inky();
+        void decideTurn(const World& world);
+};
+
+//the blue ghost
+class Clyde : public Entity
+{
+    public:
+        Clyde();
+        void decideTurn(const World& world);
+};
+
+
+//board tile class
+//a thin read-only handle onto one tile, its exits live in MAZE and its pellet in the board
+//pellets are crossed off through Board::crossOff
+class Tile
+{
+    public:
+        //points at tile index of board
+        Tile(const Board* b, int index);
+
+        //check if tile has been crossed
+        bool getCrossed() const;
+
+        //check if player can move in each direction
+        bool canGoUp() const;
+        bool canGoDown() const;
+        bool canGoLeft() const;
+        bool canGoRight() const;
+
+    private:
+        //board the tile belongs to
+        const Board* board;
+
+        //row * BOARD_COLUMNS + column
+        int index;
+};
+
+//Game board class
+class Board
+{
+    public:
+        //initializes variables
+        Board();
+
+        //updates board, returns the tile index crossed off this call or -1
+        int updateBoard(const Player& player);
+
+        //grabs a handle to a tile
+        Tile getTile(int i, int j) const;
+
+        //exit mask of tile index, bit (1 << direction) set if entities can leave that way
+        int getExits(int index) const
+        {
+            return (MAZE.exits[index >> 1] >> ((index & 1) << 2)) & 15;
+        }
+
+        //check or set if tile index has been crossed
+        bool getCrossed(int index) const
+        {
+            return (crossed[index >> 6] >> (index & 63)) & 1;
+        }
+
+        //true while walkable tile index still has its pellet
+        bool hasPellet(int index) const
+        {
+            return ((MAZE.walkable[index >> 6] & ~crossed[index >> 6]) >> (index & 63)) & 1;
+        }
+
+        void crossOff(int index)
+        {
+            crossed[index >> 6] |= (uint64_t)1 << (index & 63);
+        }
+
+        //walkable tiles the player has not crossed yet
+        int pelletsLeft() const;
+
+        //true once every walkable tile has been crossed
+        bool allEaten() const;
+
+        //copies the crossed bits into words, or back out of them
+        void capture(uint64_t* words) const
+        {
+            memcpy(words, crossed, sizeof(crossed));
+        }
+
+        void restore(const uint64_t* words)
+        {
+            memcpy(crossed, words, sizeof(crossed));
+        }
+
+    private:
+        //pellet state, one bit per tile the player has been on
+        uint64_t crossed[BOARD_WORDS];
+};
+
+//read-only view of everything movement and ghost ai look at
+//holds references only, so handing it around never copies the board
+class World
+{
+    public:
+        World(const Board& b, const Player& p, const Blinky& blink, int ai = ARCADE_AI)
+            : board(b), player(p), blinky(blink), ghostAI(ai)
+        {
+        }
+
+        const Board& getBoard() const
+        {
+            return board;
+        }
+
+        const Player& getPlayer() const
+        {
+            return player;
+        }
+
+        const Blinky& getBlinky() const
+        {
+            return blinky;
+        }
+
+        //how ghosts pick their turns
+        int getGhostAI() const
+        {
+            return ghostAI;
+        }
+
+        //shortcut for the tile topology
+        Tile getTile(int i, int j) const
+        {
+            return board.getTile(i, j);
+        }
+
+    private:
+        const Board& board;
+        const Player& player;
+        const Blinky& blinky;
+        int ghostAI;
+};
+
+//Shortest paths between every pair of tiles, found by BFS over MAZE
+//rows are indexed by destination, so a tile's neighbours share a cache line or two
+class PathTable
+{
+    public:
+        //runs a BFS from every walkable tile
+        PathTable();
+
+        //steps from tile from to tile to, UNREACHABLE if there is no path
+        int getDistance(int from, int to) const
+        {
+            return distance[to][from];
+        }
+
+        //direction of the first step from tile from towards tile to, DEFAULT if there is none
+        int getNextHop(int from, int to) const
+        {
+            return nextHop[to][from];
+        }
+
+        //walkable tile closest to goal, goal may be off the board
+        int nearestWalkable(int goalY, int goalX) const;
+
+        //direction a ghost on tile from heading in orientation should take towards the goal
+        //ghosts may not reverse, fleeing ghosts take the turn that leaves them furthest away
+        int steer(int from, int orientation, int goalY, int goalX, bool flee) const;
+
+        enum
+        {
+            UNREACHABLE = 255
+        };
+
+    private:
+        uint8_t distance[BOARD_TILES][BOARD_TILES];
+        uint8_t nextHop[BOARD_TILES][BOARD_TILES];
+
+        //closest walkable tile of every tile
+        int16_t nearest[BOARD_TILES];
+};
+
+//Maze compressed to the places where ghosts have a real choice
+//nodes are tiles with three or more exits, edges are the corridors between them
+class JunctionGraph
+{
+    public:
+        //walks every corridor of MAZE
+        JunctionGraph();
+
+        //node of tile index, -1 if it is not a junction
+        int getNode(int index) const
+        {
+            return node[index];
+        }
+
+        int getNodeCount() const
+        {
+            return (int)tiles.size();
+        }
+
+        //tile of node
+        int getTile(int n) const
+        {
+            return tiles[n];
+        }
+
+        //junction reached by leaving node n in direction dir, -1 if it can't go that way
+        int getNeighbour(int n, int dir) const
+        {
+            return edges[n * 4 + dir].to;
+        }
+
+        //corridor length in tiles from node n in direction dir
+        int getLength(int n, int dir) const
+        {
+            return edges[n * 4 + dir].length;
+        }
+
+        //way on for an entity on tile index heading in orientation
+        //CHOICE if there is more than one, DEFAULT if there is none
+        int corridorTurn(int index, int orientation) const
+        {
+            return forced[index][orientation];
+        }
+
+        enum
+        {
+            CHOICE = -1
+        };
+
+    private:
+        struct Edge
+        {
+            int16_t to;
+            int16_t length;
+        };
+
+        int16_t node[BOARD_TILES];
+        std::vector<int16_t> tiles;
+        std::vector<Edge> edges;
+
+        //only exit that doesn't turn back, per tile and orientation
+        int8_t forced[BOARD_TILES][DEFAULT + 1];
+};
+
+//Positions, orientations and flags of many entities in parallel arrays
+//for swarm games with hundreds or thousands of ghosts, where one object per ghost doesn't scale
+class EntityStore
+{
+    public:
+        //initializes variables
+        EntityStore();
+
+        //adds an entity at a pixel location, returns its slot
+        int add(int x, int y, int orientation);
+
+        int size() const
+        {
+            return count;
+        }
+
+        int getXLoc(int i) const
+        {
+            return xLoc[i];
+        }
+
+        int getYLoc(int i) const
+        {
+            return yLoc[i];
+        }
+
+        int getOrientation(int i) const
+        {
+            return orientation[i];
+        }
+
+        int getFlags(int i) const
+        {
+            return flags[i];
+        }
+
+        int getNextTurn(int i) const
+        {
+            return nextTurn[i];
+        }
+
+        void setNextTurn(int i, int turn)
+        {
+            nextTurn[i] = turn;
+        }
+
+        //tile index entity i is on, the way Entity::update sees it
+        int getTile(int i) const
+        {
+            return (std::max(yLoc[i] - 4, 0) >> 3) * BOARD_COLUMNS + (std::max(xLoc[i] - 4, 0) >> 3);
+        }
+
+        //moves every entity exactly like Entity::update, four at a time with SSE2
+        void update(const Board& board);
+
+    private:
+        //same kernel one entity at a time, for builds without SSE2
+        void updateScalar(const Board& board, int begin, int end);
+
+        //entities in use, the arrays are padded to a multiple of four
+        int count;
+
+        std::vector<int32_t> xLoc;
+        std::vector<int32_t> yLoc;
+        std::vector<int32_t> orientation;
+        std::vector<int32_t> nextTurn;
+        std::vector<int32_t> flags;
+
+        //scratch for tile indices and the exits gathered for them
+        std::vector<int32_t> exits;
+};
+
+//Things that happened during a Game step, for lining up hitches with what was on screen and for sound
+enum GameEvents
+{
+    GAME_ENERGIZER = 1,
+    GAME_GHOST_EATEN = 2,
+    GAME_DEATH = 4,
+
+    //the player's mouth shut while eating, every few frames, so the frame monitor leaves it out
+    GAME_CHOMP = 8,
+
+    //kinds the frame monitor tallies, the low bits
+    GAME_EVENT_KINDS = 3
+};
+
+//Everything the rules need to advance a game by one frame
+//knows nothing about windows, textures or renderers
+class Game
+{
+    public:
+        //sets up a fresh game with ghosts steering by ai
+        Game(int ai = ARCADE_AI);
+
+        //sets where the player will try to turn next
+        void steer(int direction)
+        {
+            player.setNextTurn(direction);
+        }
+
+        //advances the game one frame, returns false once the game is over
+        bool step();
+
+        //snapshot of the whole game, restoring it picks up exactly where capture left off
+        void capture(GameState& state) const;
+        void restore(const GameState& state);
+
+        //state for rendering and reporting
+        const Board& getBoard() const
+        {
+            return board;
+        }
+
+        const Player& getPlayer() const
+        {
+            return player;
+        }
+
+        const Blinky& getBlinky() const
+        {
+            return blinky;
+        }
+
+        const Pinky& getPinky() const
+        {
+            return pinky;
+        }
+
+        const Inky& getInky() const
+        {
+            return inky;
+        }
+
+        int getFrame() const
+        {
+            return frame;
+        }
+
+        int getFleeFrame() const
+        {
+            return fleeFrame;
+        }
+
+        //tile crossed off during the last step, or -1
+        int getCrossedTile() const
+        {
+            return crossedTile;
+        }
+
+        //GameEvents bits of the last step
+        int getEvents() const
+        {
+            return events;
+        }
+
+    private:
+        //true if the player is on a pellet or heading straight into one
+        bool nearPellet() const;
+
+        Board board;
+        Player player;
+        Blinky blinky;
+        Pinky pinky;
+        Inky inky;
+
+        //current frame
+        int frame;
+
+        //frame when fleeing starts
+        int fleeFrame;
+
+        //tile crossed off during the last step
+        int crossedTile;
+
+        //what happened during the last step
+        int events;
+
+        //ghost targeting mode
+        int ghostAI;
+};
+
+//N independent games stepped together by one call, held in one contiguous array
+//agents pass one action per game, finished games start over when autoReset is on
+//games stay whole rather than split into per-field arrays: a step reads and writes every field of one game,
+//branches differently per game, and the rest of the code snapshots and draws whole Games
+class BatchEnv
+{
+    public:
+        //sets up count fresh games with ghosts steering by ai
+        BatchEnv(int count, int ai = ARCADE_AI, bool autoReset = true);
+
+        //steps every game once, actions[i] is a direction for game i or DEFAULT to keep going
+        //games that ended without autoReset are left where they are
+        void step(const int* actions);
+
+        //starts game i over
+        void reset(int i);
+
+        //replaces every game with count fresh ones, keeping the storage already allocated
+        void restart(int count, int ai);
+
+        //puts game i back to a snapshot
+        void restore(int i, const GameState& state);
+
+        int size() const
+        {
+            return (int)games.size();
+        }
+
+        const Game& getGame(int i) const
+        {
+            return games[i];
+        }
+
+        //1 for games that ended during the last step, or that have ended without autoReset
+        const uint8_t* getDone() const
+        {
+            return done.data();
+        }
+
+        //pellets eaten by each game during the last step
+        const int8_t* getReward() const
+        {
+            return reward.data();
+        }
+
+        //number of games finished since the batch was created
+        long getEpisodes() const
+        {
+            return episodes;
+        }
+
+        //true while any game is still being played
+        bool running() const;
+
+    private:
+        std::vector<Game> games;
+        std::vector<uint8_t> done;
+        std::vector<int8_t> reward;
+
+        long episodes;
+        int ghostAI;
+        bool autoReset;
+};
+
+//How one game of a BatchRunner run ended
+struct GameResult
+{
+    int frames;
+    int pellets;
+    bool died;
+};
+
+//Plays runs of independent games on a pool of worker threads
+//games are dealt out in chunks, and a worker that runs dry steals from the back of another's queue
+class BatchRunner
+{
+    public:
+        //starts the worker threads
+        BatchRunner(int threads);
+
+        //stops and joins the worker threads
+        ~BatchRunner();
+
+        //plays count games with ghosts steering by ai, each driven by a random bot seeded from seed and its index
+        //results[i] is game i however the games were split, so results only depend on the arguments
+        void run(int count, uint32_t seed, int ai, int maxFrames, std::vector<GameResult>& results);
+
+        int getThreads() const
+        {
+            return (int)threads.size();
+        }
+
+        //chunks taken from another worker's queue during the last run
+        long getSteals() const;
+
+        //games per chunk
+        static constexpr int CHUNK = 64;
+
+    private:
+        //padded to a cache line so workers never write to each other's lines
+        struct alignas(64) Worker
+        {
+            Worker() : arena(0, ARCADE_AI, false)
+            {
+                steals = 0;
+            }
+
+            //chunks this worker starts with, the owner pops the front and thieves the back
+            std::mutex lock;
+            std::deque<int> chunks;
+
+            //games and bot state for the chunk being played, allocated by the worker itself
+            BatchEnv arena;
+            std::vector<int> actions;
+            std::vector<uint32_t> seeds;
+
+            long steals;
+        };
+
+        //thread body
+        void work(int id);
+
+        //next chunk for worker id, from its own queue or stolen, false once every queue is empty
+        bool takeChunk(int id, int& chunk);
+
+        //plays one chunk of games to the end in the worker's arena
+        void playChunk(Worker& worker, int chunk);
+
+        std::vector<std::thread> threads;
+        std::vector<Worker> workers;
+
+        //wakes workers for a new run and tells run() when they are done
+        std::mutex lock;
+        std::condition_variable wake;
+        std::condition_variable finished;
+        int generation;
+        int busy;
+        bool stopping;
+
+        //the current run
+        int jobCount;
+        uint32_t jobSeed;
+        int jobAI;
+        int jobMaxFrames;
+        GameResult* jobResults;
+};
+
+//The last 30 seconds of a game, one state per tick, in a fixed amount of memory
+//states are grouped into one second segments of a keyframe followed by XOR deltas against it,
+//each delta a mask of the 64-bit words that differ and then those words
+class RewindBuffer
+{
+    public:
+        static constexpr int SEGMENT_TICKS = TICKS_PER_SECOND;
+
+        //one spare segment so a full 30 seconds is kept while the newest one fills
+        static constexpr int SEGMENTS = 30 + 1;
+
+        //delta bytes per segment, a segment ends early if they run out
+        static constexpr int SEGMENT_BYTES = 4096;
+
+        //allocates every segment up front
+        RewindBuffer();
+
+        //forgets everything
+        void clear();
+
+        //records the state of game as the newest tick, dropping the oldest second once full
+        void push(const Game& game);
+
+        //takes the newest tick back out into state, false once there is nothing left
+        bool pop(GameState& state);
+
+        //ticks that can be rewound
+        int getTicks() const;
+
+        //bytes held by the buffer, fixed from construction
+        size_t getMemory() const
+        {
+            return segments.size() * sizeof(Segment);
+        }
+
+        //delta bytes in use, for reporting compression
+        size_t getDeltaBytes() const;
+
+    private:
+        struct Segment
+        {
+            GameState keyframe;
+
+            //where each tick's delta starts in bytes, tick 0 is the keyframe itself
+            uint16_t offsets[SEGMENT_TICKS];
+            uint16_t used;
+            uint16_t ticks;
+            uint8_t bytes[SEGMENT_BYTES];
+        };
+
+        std::vector<Segment> segments;
+
+        //segment being written and how many hold ticks
+        int newest;
+        int count;
+};
+
+//Where the player and ghosts were before the latest step
+//rendering blends from here to the current positions
+struct EntityPositions
+{
+    //player, blinky, pinky, inky
+    int x[4];
+    int y[4];
+};
+
+//Player input read from a text file, one "<frame> <RIGHT|LEFT|UP|DOWN>" per line
+class InputScript
+{
+    public:
+        //initializes variables
+        InputScript();
+
+        //loads script at specified path
+        bool loadFromFile( std::string path );
+
+        //turn to take on frame, DEFAULT if there is none
+        //frames have to be asked for in increasing order
+        int turnAt(int frame);
+
+        //starts the script over
+        void rewind();
+
+    private:
+        //frame and direction of each turn, sorted by frame
+        std::vector<int> frames;
+        std::vector<int> turns;
+
+        //next turn to hand out
+        size_t next;
+};
+
+//First bytes of a replay file, followed by one 4-byte record per turn until the end of the file
+//records are tick << 3 | direction, and a DEFAULT direction marks the tick the session stopped
+//everything is stored little-endian, as written by x86 and ARM
+struct ReplayHeader
+{
+    char magic[4];
+    uint16_t version;
+    uint8_t ghostAI;
+    uint8_t ticksPerSecond;
+
+    //seed of any randomness in the session, 0 for keyboard play
+    uint32_t seed;
+    uint32_t reserved;
+
+    //maze the session was played on, replays of other mazes are refused
+    uint64_t mazeHash;
+};
+
+static_assert(sizeof(ReplayHeader) == 24, "replay header layout changed");
+
+//Appends turns to a replay file from a background thread so the frame loop never waits on the disk
+class ReplayWriter
+{
+    public:
+        //initializes variables
+        ReplayWriter();
+
+        //finishes the file if it is still open
+        ~ReplayWriter();
+
+        //creates the file at path and writes its header
+        bool open( std::string path, int ai, uint32_t seed );
+
+        //queues a turn taken on tick
+        void append( int tick, int direction );
+
+        //marks the session as stopped on tick, writes what is left and closes the file, false if any of it failed to write
+        bool close( int tick );
+
+        bool isOpen() const
+        {
+            return file != NULL;
+        }
+
+    private:
+        //thread body, writes out whatever has been queued
+        void work();
+
+        std::string path;
+        FILE* file;
+        std::thread thread;
+
+        //set by the writer thread once a write fails, the records after it are dropped
+        std::atomic<bool> failed;
+
+        //records waiting for the writer thread
+        std::mutex lock;
+        std::condition_variable wake;
+        std::vector<uint32_t> pending;
+        bool stopping;
+};
+
+//Read-only view of a whole file, mapped where the platform allows and read in otherwise
+class MappedFile
+{
+    public:
+        //initializes variables
+        MappedFile();
+
+        //unmaps the file
+        ~MappedFile();
+
+        //maps the file at path
+        bool open( std::string path );
+
+        //unmaps the file
+        void close();
+
+        const uint8_t* getData() const
+        {
+            return data;
+        }
+
+        size_t getSize() const
+        {
+            return size;
+        }
+
+    private:
+        const uint8_t* data;
+        size_t size;
+
+        //copy of the file where it can't be mapped
+        std::vector<uint8_t> buffer;
+};
+
+//Replay file mapped into memory, read in place
+class ReplayFile
+{
+    public:
+        //initializes variables
+        ReplayFile();
+
+        //unmaps the file
+        ~ReplayFile();
+
+        //maps the file at path and checks its header against this build
+        bool open( std::string path );
+
+        //unmaps the file
+        void close();
+
+        const ReplayHeader& getHeader() const
+        {
+            return *(const ReplayHeader*)file.getData();
+        }
+
+        //hash of every byte of the file, to tell recordings apart
+        uint64_t getHash() const;
+
+        //number of records, including the end marker if there is one
+        int getRecordCount() const
+        {
+            return records;
+        }
+
+        //tick and direction of record i
+        int getTick(int i) const
+        {
+            return (int)(record(i) >> 3);
+        }
+
+        int getDirection(int i) const
+        {
+            return (int)(record(i) & 7);
+        }
+
+        //tick the session stopped on, or -1 if the recording was cut off
+        int getEndTick() const;
+
+        //index of the first record on or after tick
+        int seek(int tick) const;
+
+        //turn to take on tick, DEFAULT if there is none
+        //ticks have to be asked for in increasing order, unless the file is rewound or moved to a tick
+        int turnAt(int tick);
+
+        //continues from the first record on or after tick
+        void moveTo(int tick);
+
+        //starts the replay over
+        void rewind();
+
+    private:
+        uint32_t record(int i) const
+        {
+            uint32_t value;
+            memcpy(&value, file.getData() + sizeof(ReplayHeader) + (size_t)i * 4, 4);
+            return value;
+        }
+
+        MappedFile file;
+
+        int records;
+
+        //next record to hand out
+        int next;
+};
+
+//First bytes of a keyframe index, followed by count GameStates taken every interval ticks from tick 0
+struct KeyframeHeader
+{
+    char magic[4];
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t interval;
+    uint32_t count;
+
+    //replay the keyframes were taken from, stale indexes are rebuilt
+    uint64_t replayHash;
+};
+
+static_assert(sizeof(KeyframeHeader) == 24, "keyframe header layout changed");
+
+//Snapshots of a replay at regular ticks, kept next to it so seeking only replays the last stretch
+class KeyframeIndex
+{
+    public:
+        //ticks between keyframes, one a minute keeps a 10 hour replay's index around 100KB
+        static constexpr int INTERVAL = TICKS_PER_SECOND * 60;
+
+        //initializes variables
+        KeyframeIndex();
+
+        //plays replay from the start and writes its keyframes to path
+        bool build( ReplayFile& replay, std::string path, int interval = INTERVAL );
+
+        //maps the index at path, false if it is missing or belongs to another replay
+        bool open( std::string path, const ReplayFile& replay );
+
+        //opens the index at path, building it first if needed
+        bool openOrBuild( std::string path, ReplayFile& replay );
+
+        //unmaps the index
+        void close();
+
+        int getKeyframeCount() const
+        {
+            return count;
+        }
+
+        //puts game on tick of replay, restoring the nearest keyframe before it and playing on from there
+        //replay carries on from tick afterwards, false if the game ended before reaching it
+        bool seek( ReplayFile& replay, Game& game, int tick ) const;
+
+    private:
+        MappedFile file;
+        int interval;
+        int count;
+};
+
+//Lock-free hand-off of the newest value from one writer thread to one reader thread
+//three slots, so the writer always has one to fill and the reader always has one to look at, and neither ever waits
+template <typename T>
+class TripleBuffer
+{
+    public:
+        //initializes variables
+        TripleBuffer() : middle( 1 )
+        {
+            back = 0;
+            front = 2;
+        }
+
+        //slot the writer fills next
+        T& getBack()
+        {
+            return slots[ back ];
+        }
+
+        //hands the filled back slot to the reader, replacing anything it hasn't picked up yet
+        void publish()
+        {
+            back = middle.exchange( back | FRESH, std::memory_order_acq_rel ) & INDEX;
+        }
+
+        //takes the newest published slot, false if nothing was published since the last call
+        bool update()
+        {
+            if( !( middle.load( std::memory_order_relaxed ) & FRESH ) )
+            {
+                return false;
+            }
+            front = middle.exchange( front, std::memory_order_acq_rel ) & INDEX;
+            return true;
+        }
+
+        //slot the reader took last
+        const T& getFront() const
+        {
+            return slots[ front ];
+        }
+
+    private:
+        //the middle slot's index, with FRESH set while the reader hasn't taken it
+        static constexpr int INDEX = 3;
+        static constexpr int FRESH = 4;
+
+        T slots[ 3 ];
+        alignas( 64 ) std::atomic<int> middle;
+        int back;
+        int front;
+};
+
+//One simulated tick as the renderer sees it
+struct FrameSnapshot
+{
+    //game after the tick
+    GameState state;
+
+    //positions before it, to blend from
+    EntityPositions previous;
+
+    //performance counter when the tick finished
+    Uint64 time;
+};
+
+//Steps a windowed game at the fixed tick rate on its own thread, publishing a snapshot after every tick
+//a present blocked on vsync never holds the simulation up, and input reaches it through atomics
+class SimulationThread
+{
+    public:
+        //steps game 0 of env, with turns from replay if given, into recorder if open, keeping rewind history in rewind if given
+        SimulationThread( BatchEnv& env, ReplayFile* replay, ReplayWriter& recorder, RewindBuffer* rewind, int endTick );
+
+        //stops the thread if it is still running
+        ~SimulationThread();
+
+        //starts stepping from now
+        void start();
+
+        //asks the thread to stop and waits for it, the game can be read again afterwards
+        void stop();
+
+        //turn to take on the next tick, like a key press it is used once
+        void setAction( int action );
+
+        //steps back instead of forwards while b is set
+        void setRewinding( bool b );
+
+        //true once the game ended or the replay ran out
+        bool isFinished() const
+        {
+            return finished.load( std::memory_order_acquire );
+        }
+
+        //GameEvents of every tick since the last call
+        int takeEvents()
+        {
+            return events.exchange( 0, std::memory_order_relaxed );
+        }
+
+        //picks up the newest snapshot, false if there is no new one
+        bool update()
+        {
+            return snapshots.update();
+        }
+
+        const FrameSnapshot& getSnapshot() const
+        {
+            return snapshots.getFront();
+        }
+
+    private:
+        //thread body, one tick per tick length until stopped
+        void run();
+
+        BatchEnv& env;
+        ReplayFile* replay;
+        ReplayWriter& recorder;
+        RewindBuffer* rewind;
+        int endTick;
+
+        std::thread thread;
+        TripleBuffer<FrameSnapshot> snapshots;
+
+        //from the main thread
+        std::atomic<int> action;
+        std::atomic<bool> rewinding;
+        std::atomic<bool> stopping;
+
+        //to the main thread
+        std::atomic<bool> finished;
+        std::atomic<int> events;
+};
+
+//Parts of a frame the profiler times
+enum ProfilePhase
+{
+    PROFILE_EVENTS,
+    PROFILE_SIMULATION,
+    PROFILE_BOARD_UPDATE,
+    PROFILE_PLAYER,
+    PROFILE_GHOSTS,
+    PROFILE_BOARD_RENDER,
+    PROFILE_SPRITES,
+    PROFILE_PRESENT,
+    PROFILE_FRAME,
+    PROFILE_PHASES
+};
+
+//Per phase timings of the main loop, rolling stats over the last WINDOW frames
+//only the main loop turns it on, so games stepped on worker threads are never timed
+class Profiler
+{
+    public:
+        //frames the rolling stats cover
+        static constexpr int WINDOW = 128;
+
+        //scopes kept for the trace, and frames kept for the CSV, before they stop growing
+        static constexpr int MAX_EVENTS = 1 << 20;
+        static constexpr int MAX_FRAMES = 1 << 18;
+
+        //initializes variables
+        Profiler();
+
+        //starts or stops timing, stays off when scopes are compiled out
+        void setEnabled(bool b);
+
+        bool isEnabled() const
+        {
+            return enabled;
+        }
+
+        //scopes only count on the thread that turned timing on, so a simulation thread goes untimed
+        bool isTiming() const
+        {
+            return enabled && std::this_thread::get_id() == owner;
+        }
+
+        //keeps every scope for writeTrace, and every frame's totals for writeCSV
+        void setTracing(bool b)
+        {
+            tracing = b;
+        }
+
+        void setLogging(bool b)
+        {
+            logging = b;
+        }
+
+        //adds a finished scope of phase that ran from start to end
+        void record(int phase, Uint64 start, Uint64 end);
+
+        //moves the totals of the frame so far into the rolling window
+        void endFrame();
+
+        //min, average and 99th percentile of phase over the window, in milliseconds
+        void getStats(int phase, float& min, float& avg, float& p99) const;
+
+        //total of phase in the last finished frame, in milliseconds
+        float getLast(int phase) const
+        {
+            return frames ? history[(frames - 1) % WINDOW][phase] : 0.0f;
+        }
+
+        //prints the stats of every phase
+        void printStats() const;
+
+        //writes the traced scopes as Chrome trace event JSON
+        bool writeTrace( std::string path ) const;
+
+        //writes each frame's phase totals as CSV, one row per frame
+        bool writeCSV( std::string path ) const;
+
+        static const char* getName(int phase);
+
+    private:
+        struct Event
+        {
+            Uint64 start;
+            Uint64 end;
+            int phase;
+        };
+
+        bool enabled;
+        bool tracing;
+        bool logging;
+
+        //thread that enabled timing
+        std::thread::id owner;
+
+        //time the trace starts from
+        Uint64 origin;
+
+        //totals of the frame in progress, in counter ticks
+        Uint64 current[PROFILE_PHASES];
+        bool touched;
+
+        //per frame totals in milliseconds, WINDOW of them in a ring
+        float history[WINDOW][PROFILE_PHASES];
+        int frames;
+
+        std::vector<Event> events;
+        std::vector<float> log;
+};
+
+//Frame durations in microseconds, bucketed HDR style: powers of two split into 16 linear steps,
+//so every duration from a microsecond to a minute is kept to within about 6%
+class FrameHistogram
+{
+    public:
+        static constexpr int SUB_BITS = 5;
+        static constexpr int SUB_COUNT = 1 << SUB_BITS;
+        static constexpr int MAX_BITS = 26;
+        static constexpr int BUCKETS = (MAX_BITS - SUB_BITS) * (SUB_COUNT / 2) + SUB_COUNT;
+
+        //initializes variables
+        FrameHistogram();
+
+        //empties every bucket
+        void clear();
+
+        //adds one duration
+        void record(Uint64 microseconds);
+
+        long getCount() const
+        {
+            return count;
+        }
+
+        Uint64 getMax() const
+        {
+            return max;
+        }
+
+        double getMean() const
+        {
+            return count ? (double)sum / count : 0.0;
+        }
+
+        //upper bound of the bucket holding the p-th percentile
+        Uint64 percentile(double p) const;
+
+    private:
+        static int bucketOf(Uint64 value);
+        static Uint64 highestIn(int bucket);
+
+        long counts[BUCKETS];
+        long count;
+        Uint64 sum;
+        Uint64 max;
+};
+
+//Watches frame times for frames that miss their display refresh, and notes what ran long and what was happening
+class FrameMonitor
+{
+    public:
+        //hitches kept in detail, later ones are only counted
+        static constexpr int MAX_HITCHES = 64;
+
+        //initializes variables
+        FrameMonitor();
+
+        //adds a frame that lasted microseconds against a refresh period of deadline
+        //events are the GameEvents of its steps, phases come from the profiler's last frame when it is on
+        void recordFrame(Uint64 microseconds, Uint64 deadline, int gameFrame, int events, const Profiler& profiler);
+
+        //prints the histogram, hitch causes and how often each game event came with a hitch
+        void printSummary() const;
+
+    private:
+        struct Hitch
+        {
+            int gameFrame;
+            Uint64 microseconds;
+            int phase;
+            int events;
+        };
+
+        //phase that took longest in the profiler's last frame, PROFILE_FRAME when nothing timed explains it
+        static int slowestPhase(const Profiler& profiler);
+
+        FrameHistogram histogram;
+        std::vector<Hitch> hitches;
+        long hitchCount;
+        long hitchesByPhase[PROFILE_PHASES];
+
+        //frames with each event, and how many of those hitched
+        long eventFrames[GAME_EVENT_KINDS];
+        long eventHitches[GAME_EVENT_KINDS];
+
+        //events of the frame before, a hitch often lands just after what caused it
+        int lastEvents;
+};
+
+//Time from an arrow key press to the player turning, and to the first present showing the turn
+//turns only happen at tile centres, so the ticks in between are the game's share and the rest is the loop's
+class LatencyTracker
+{
+    public:
+        //presses that haven't turned the player after this many ticks are given up on
+        static constexpr int TIMEOUT_TICKS = TICKS_PER_SECOND * 2;
+
+        //initializes variables
+        LatencyTracker();
+
+        //notes a press of direction at counter time, while game is the one on screen
+        void press(int direction, Uint64 time, const Game& game);
+
+        //looks for the pending turn in game after a step or a new snapshot, time is when that tick finished
+        void update(const Game& game, Uint64 time);
+
+        //the frame drawn from the last update was presented at time
+        void presented(Uint64 time);
+
+        //pushes a synthetic key press for a turn the player's tile allows, one at a time
+        //false once samples presses have been measured
+        bool inject(const Game& game, int samples);
+
+        //presses measured all the way to a present
+        long getSamples() const
+        {
+            return toPresent.getCount();
+        }
+
+        //prints the distributions and what happened to presses that weren't measured
+        void printSummary() const;
+
+    private:
+        struct Press
+        {
+            int direction;
+            int tick;
+            Uint64 time;
+            Uint64 turnTime;
+        };
+
+        //press waiting for its turn
+        Press pending;
+        bool waiting;
+
+        //turns taken since the last present
+        std::vector<Press> turned;
+
+        //press to turn, press to present, and ticks spent waiting for a tile centre
+        FrameHistogram toTurn;
+        FrameHistogram toPresent;
+        long ticks;
+
+        long superseded;
+        long timedOut;
+
+        Uint64 frequency;
+
+        //picks injected turns, and the tick the last one went in
+        uint32_t random;
+        int lastInjected;
+};
+
+//Times the rest of the enclosing block as phase while the profiler is on
+class ProfileScope
+{
+    public:
+        ProfileScope(int p);
+        ~ProfileScope();
+
+    private:
+        int phase;
+        Uint64 start;
+};
+
+#if PACMAN_PROFILE
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(phase) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(phase)
+#else
+#define PROFILE_SCOPE(phase) do {} while (0)
+#endif
+
+//Texture wrapper class
+class LTexture
+{
+	public:
+		//Initializes variables
+		LTexture();
+
+		//Deallocates memory
+		~LTexture();
+
+		//Loads image at specified path
+		bool loadFromFile( std::string path );
+
+		//Creates blank texture
+		bool createBlank( int width, int height, SDL_TextureAccess access );
+
+		//Deallocates texture
+		void free();
+
+		//Renders texture at given point
+		void render( int x, int y, SDL_Rect* clip = NULL );
+
+		//Set self as render target
+		void setAsRenderTarget();
+
+		//Gets image dimensions
+		int getWidth();
+		int getHeight();
+
+	private:
+		//The actual hardware texture
+		SDL_Texture* mTexture;
+
+		//Image dimensions
+		int mWidth;
+		int mHeight;
+};
+
+//Board image kept in a target texture
+//composed once, then only tiles whose crossed state changed are redrawn
+class BoardTexture
+{
+    public:
+        //initializes variables
+        BoardTexture();
+
+        //creates the target texture, false if the renderer can't render to textures
+        bool create();
+
+        //deallocates texture
+        void free();
+
+        //forces every tile to be redrawn, e.g. after render targets were reset
+        void invalidate();
+
+        //redraws the tiles whose pellet changed since the last render and copies the board to the screen
+        void render(const Board& board);
+
+    private:
+        //draws one tile at the current render target
+        void renderTile(const Board& board, int index);
+
+        //cached board image
+        LTexture texture;
+
+        //crossed bits the texture was drawn with, tiles that differ are redrawn
+        uint64_t drawn[BOARD_WORDS];
+
+        //if the texture holds a full board yet
+        bool composed;
+};
+
+//Frame composed on the CPU in an ARGB framebuffer and uploaded as one streaming texture
+//a single upload per frame beats dozens of small copies when SDL's renderer is itself software
+class SoftRenderer
+{
+    public:
+        //initializes variables
+        SoftRenderer();
+
+        //copies the sprite sheet at path into memory and creates the streaming texture
+        bool create(std::string path);
+
+        //deallocates pixels and texture
+        void free();
+
+        //true once create succeeded
+        bool isActive() const;
+
+        //forces every tile to be redrawn
+        void invalidate();
+
+        //patches tiles whose crossed state changed and copies the board into the frame
+        void renderBoard(const Board& board);
+
+        //draws clip of the sprite sheet at x, y in the frame, black pixels are transparent
+        void renderSprite(int x, int y, const SDL_Rect* clip);
+
+        //uploads the frame and copies it to the screen
+        void present();
+
+        //the frame as composed so far, SCREEN_WIDTH pixels a row
+        const uint32_t* getPixels() const
+        {
+            return &frame[0];
+        }
+
+        //copies a w by h block of src over dst, skipping black source pixels
+        static void blitKeyed(uint32_t* dst, int dstPitch, const uint32_t* src, int srcPitch, int w, int h);
+
+    private:
+        //draws one tile into the cached board
+        void renderTile(const Board& board, int index);
+
+        //sprite sheet pixels, ARGB8888
+        std::vector<uint32_t> sheet;
+        int sheetWidth;
+        int sheetHeight;
+
+        //cached board and the frame being composed, SCREEN_WIDTH pixels a row
+        std::vector<uint32_t> board;
+        std::vector<uint32_t> frame;
+
+        //crossed bits the cached board was drawn with
+        uint64_t drawn[BOARD_WORDS];
+
+        //if the cached board holds a full board yet
+        bool composed;
+
+        //streaming texture the frame is uploaded to
+        SDL_Texture* texture;
+};
+
+//Fixed size queue from one producer thread to one consumer thread, no locks and no allocation
+template <typename T, int N>
+class SpscQueue
+{
+    static_assert((N & (N - 1)) == 0, "queue size must be a power of two");
+
+    public:
+        //initializes variables
+        SpscQueue() : head(0), tail(0)
+        {
+        }
+
+        //producer side, false if the queue is full
+        bool push(const T& value)
+        {
+            unsigned t = tail.load(std::memory_order_relaxed);
+            if (t - head.load(std::memory_order_acquire) == (unsigned)N)
+            {
+                return false;
+            }
+            items[t & (N - 1)] = value;
+            tail.store(t + 1, std::memory_order_release);
+            return true;
+        }
+
+        //consumer side, false if the queue is empty
+        bool pop(T& value)
+        {
+            unsigned h = head.load(std::memory_order_relaxed);
+            if (h == tail.load(std::memory_order_acquire))
+            {
+                return false;
+            }
+            value = items[h & (N - 1)];
+            head.store(h + 1, std::memory_order_release);
+            return true;
+        }
+
+    private:
+        T items[N];
+
+        //each end on its own cache line
+        alignas(64) std::atomic<unsigned> head;
+        alignas(64) std::atomic<unsigned> tail;
+};
+
+//Sound effects, one voice each
+enum Sounds
+{
+    SOUND_CHOMP,
+    SOUND_SIREN,
+    SOUND_ENERGIZER,
+    SOUND_GHOST_EATEN,
+    SOUND_DEATH,
+    SOUNDS
+};
+
+//What the game asks a voice to do
+enum SoundCommands
+{
+    SOUND_PLAY,     //from the start
+    SOUND_CONTINUE, //from the start unless it is already playing
+    SOUND_LOOP,     //like continue, then over and over
+    SOUND_STOP
+};
+
+//Plays the sound effects on SDL's audio thread
+//clips are converted to the device format once at load, the game only queues commands,
+//and the callback mixes with saturating 16-bit adds so it never allocates, locks or waits
+class AudioMixer
+{
+    public:
+        //frames per callback, 256 at 44.1kHz keeps a queued sound under 6ms from the speakers
+        static constexpr int BUFFER_FRAMES = 256;
+        static constexpr int FREQUENCY = 44100;
+
+        //initializes variables
+        AudioMixer();
+
+        //opens the default device, paused, false if there is no audio
+        bool open();
+
+        //decodes the WAV at path into sound's clip, a missing file leaves the sound silent
+        bool load(int sound, std::string path);
+
+        //starts the callback running
+        void resume();
+
+        //closes the device and frees the clips
+        void close();
+
+        bool isOpen() const
+        {
+            return device != 0;
+        }
+
+        //queues command for sound, dropped if the audio thread is that far behind
+        void send(int sound, int command);
+
+        //fills out with frames of mono audio, what the callback does
+        void mix(int16_t* out, int frames);
+
+        //gives sound a clip directly, for benchmarks
+        void setClip(int sound, const std::vector<int16_t>& pcm);
+
+    private:
+        struct Command
+        {
+            uint8_t sound;
+            uint8_t command;
+        };
+
+        struct Voice
+        {
+            int position;
+            bool playing;
+            bool looping;
+        };
+
+        //SDL's entry point, userdata is the mixer
+        static void callback(void* userdata, Uint8* stream, int length);
+
+        SDL_AudioDeviceID device;
+        SDL_AudioSpec spec;
+
+        //decoded clips, only touched while the device is paused
+        std::vector<int16_t> clips[SOUNDS];
+
+        //owned by the audio thread
+        Voice voices[SOUNDS];
+
+        SpscQueue<Command, 64> commands;
+};
+
+//Streams frames to disk from a background thread, as one uncompressed Y4M file or a numbered PNG sequence
+//frames wait in a fixed pool of slots, so the caller only ever blocks when every slot is still waiting for the disk
+class VideoWriter
+{
+    public:
+        //frames that can wait for the writer thread, about 3.5MB of them
+        static constexpr int QUEUE_FRAMES = 16;
+
+        //initializes variables
+        VideoWriter();
+
+        //finishes the video if it is still open
+        ~VideoWriter();
+
+        //path with one %d or %0Nd frame number, e.g. frame%05d.png, writes PNGs, a path without % one Y4M file at fps
+        //any other % in path is refused, as is a .png path without a frame number
+        bool open( std::string path, int fps );
+
+        //queues a SCREEN_WIDTH by SCREEN_HEIGHT ARGB frame
+        void write( const uint32_t* pixels );
+
+        //writes what is left and closes the video, false if any frame failed to write
+        bool close();
+
+        bool isOpen() const
+        {
+            return thread.joinable();
+        }
+
+        //times write had to wait for a free slot
+        long getStalls() const
+        {
+            return stalls;
+        }
+
+    private:
+        //thread body, writes queued frames in order
+        void work();
+
+        //converts pixels to 4:2:0 YUV and appends it to the Y4M file
+        void writeY4M( const uint32_t* pixels );
+
+        //writes pixels as the PNG numbered index
+        void writePNG( const uint32_t* pixels, int index );
+
+        std::string path;
+        FILE* file;
+        bool png;
+        std::thread thread;
+
+        //PNG names are prefix, the frame number zero padded to digits, then suffix
+        std::string prefix;
+        std::string suffix;
+        int digits;
+
+        //set by the writer thread once a write fails, the frames after it are dropped
+        std::atomic<bool> failed;
+
+        //frame slots, the ones waiting to be written in order, and the ones free to fill
+        std::vector<std::vector<uint32_t> > slots;
+        std::deque<int> queued;
+        std::vector<int> available;
+
+        std::mutex lock;
+        std::condition_variable wake;
+        std::condition_variable space;
+        bool stopping;
+        long stalls;
+
+        //writer thread's YUV planes
+        std::vector<uint8_t> planes;
+};
+
+//Starts up SDL and creates window
+bool init();
+
+//Loads media
+bool loadMedia();
+
+//Frees media and shuts down SDL
+void close();
+
+//Times every hot path as one suite, "--json" prints one JSON object per line, returns process exit code
+int runBenchmarks( int argc, char* args[] );
+
+//Measures how much the ghost update path copies per tick
+void benchmarkWorldCopies();
+
+//Measures the cost of one ghost decision with each targeting mode
+void benchmarkGhostDecisions();
+
+//Prints how much of the maze the junction graph lets ghosts skip
+void benchmarkJunctionGraph();
+
+//Times a swarm of ghosts moved as objects against the same swarm in an EntityStore
+void benchmarkSwarm();
+
+//Times batches of games driven by a random bot
+void benchmarkBatch();
+
+//Times GameState capture and restore, and checks that restored games play on identically
+void benchmarkSnapshots();
+
+//Times recording into the rewind buffer and checks that rewinding gives back every state
+void benchmarkRewind();
+
+//Plays games driven by a random bot across worker threads, returns process exit code
+int runBatch( int argc, char* args[] );
+
+//Runs a swarm of wandering ghosts with no window, returns process exit code
+int runSwarm( int argc, char* args[] );
+
+//Reads "--ai arcade|path" from args, ARCADE_AI if it isn't there, -1 after printing usage for anything else
+int ghostAIOption( int argc, char* args[] );
+
+//Value following option name in args, or NULL
+const char* stringOption( int argc, char* args[], const char* name );
+
+//True if flag name is in args
+bool flagOption( int argc, char* args[], const char* name );
+
+//Runs scripted games with no window, returns process exit code
+int runHeadless( int argc, char* args[] );
+
+//Plays a replay file back as fast as possible with no window, returns process exit code
+int runReplay( int argc, char* args[] );
+
+//Renders a replay or a bot game to a video file with no window, returns process exit code
+int runExport( int argc, char* args[] );
+
+//Hash of everything in game, equal hashes mean replays matched bit for bit
+uint64_t stateHash( const Game& game );
+
+//FNV-1a over size bytes of data
+uint64_t hashBytes( const void* data, size_t size );
+
+//Writes a SCREEN_WIDTH by SCREEN_HEIGHT ARGB frame to a PNG at path
+bool saveFramePNG( std::string path, const uint32_t* pixels );
+
+//Renders scripted games and checks frame hashes at chosen ticks against a list, returns process exit code
+int runGolden( int argc, char* args[] );
+
+//Records player and ghost positions of game
+void capturePositions( const Game& game, EntityPositions& positions );
+
+//Plays one tick of a windowed session on game 0 of env: a turn from replay or action, recorded into recorder,
+//or a step back through rewind while rewinding. false once the game ended or the replay ran out
+bool playTick( BatchEnv& env, int& action, bool rewinding, ReplayFile* replay, ReplayWriter& recorder, RewindBuffer* rewind,
+               int endTick, EntityPositions& previous, int& events );
+
+//Draws board and entities of game, alpha of the way from previous positions to the current ones
+//with the software framebuffer on this only composes the frame, gSoftRenderer.present() shows it
+void renderGame( const Game& game, const EntityPositions& previous, float alpha );
+
+//Refresh rate of the display the window is on
+int displayRefreshRate();
+
+//Draws the profiler's phase bars over the game
+void renderProfile();
+
+//Signal handler asking for a frame time summary, e.g. kill -USR1 on a running game
+void requestSummary( int signal );
+
+//The window we'll be rendering to
+SDL_Window* gWindow = NULL;
+
+//The window renderer
+SDL_Renderer* gRenderer = NULL;
+
+//Scene sprites
+SDL_Rect gBoard;
+SDL_Rect gPlayer[8];
+SDL_Rect gBoardPieces[31][28];
+SDL_Rect gBoardPiecesAlt[31][28];
+SDL_Rect gBlinky[8];
+SDL_Rect gPinky[8];
+SDL_Rect gInky[8];
+SDL_Rect gClyde[8];
+SDL_Rect gMiscGhost[8];
+SDL_Rect gPlayerDeath[12];
+LTexture gSpriteSheetTexture;
+BoardTexture gBoardTexture;
+SoftRenderer gSoftRenderer;
+AudioMixer gAudio;
+
+//Shortest paths for PATH_AI ghosts, the BFS runs the first time one of them steers
+const PathTable& pathTable()
+{
+    static PathTable table;
+    return table;
+}
+
+//Junctions, so ghosts only think where they can choose
+JunctionGraph gJunctionGraph;
+
+//Main loop phase timings
+Profiler gProfiler;
+
+//Set from a signal handler to ask the main loop for a frame time summary
+volatile sig_atomic_t gSummaryRequested = 0;
+
+inline ProfileScope::ProfileScope(int p)
+{
+    phase = p;
+    start = gProfiler.isTiming() ? SDL_GetPerformanceCounter() : 0;
+}
+
+inline ProfileScope::~ProfileScope()
+{
+    if (start)
+    {
+        gProfiler.record(phase, start, SDL_GetPerformanceCounter());
+    }
+}
+
+Tile::Tile(const Board* b, int i)
+{
+    board = b;
+    index = i;
+}
+
+bool Tile::canGoDown() const
+{
+    return (board->getExits(index) >> DOWN) & 1;
+}
+
+bool Tile::canGoUp() const
+{
+    return (board->getExits(index) >> UP) & 1;
+}
+
+bool Tile::canGoLeft() const
+{
+    return (board->getExits(index) >> LEFT) & 1;
+}
+
+bool Tile::canGoRight() const
+{
+    return (board->getExits(index) >> RIGHT) & 1;
+}
+
+bool Tile::getCrossed() const
+{
+    return board->getCrossed(index);
+}
+
+LTexture::LTexture()
+{
+	//Initialize
+	mTexture = NULL;
+	mWidth = 0;
+	mHeight = 0;
+}
+
+LTexture::~LTexture()
+{
+	//Deallocate
+	free();
+}
+
+bool LTexture::loadFromFile( std::string path )
+{
+	//Get rid of preexisting texture
+	free();
+
+	//The final texture
+	SDL_Texture* newTexture = NULL;
+
+	//Load image at specified path
+	SDL_Surface* loadedSurface = IMG_Load( path.c_str() );
+	if( loadedSurface == NULL )
+	{
+		printf( "Unable to load image %s! SDL_image Error: %s\n", path.c_str(), IMG_GetError() );
+	}
+	else
+	{
+		//Color key image
+		SDL_SetColorKey( loadedSurface, SDL_TRUE, SDL_MapRGB( loadedSurface->format, 0, 0, 0 ) );
+
+		//Create texture from surface pixels
+        newTexture = SDL_CreateTextureFromSurface( gRenderer, loadedSurface );
+		if( newTexture == NULL )
+		{
+			printf( "Unable to create texture from %s! SDL Error: %s\n", path.c_str(), SDL_GetError() );
+		}
+		else
+		{
+			//Get image dimensions
+			mWidth = loadedSurface->w;
+			mHeight = loadedSurface->h;
+		}
+
+		//Get rid of old loaded surface
+		SDL_FreeSurface( loadedSurface );
+	}
+
+	//Return success
+	mTexture = newTexture;
+	return mTexture != NULL;
+}
+
+bool LTexture::createBlank( int width, int height, SDL_TextureAccess access )
+{
+	//Get rid of preexisting texture
+	free();
+
+	//Create uninitialized texture
+	mTexture = SDL_CreateTexture( gRenderer, SDL_PIXELFORMAT_RGBA8888, access, width, height );
+	if( mTexture == NULL )
+	{
+		printf( "Unable to create blank texture! SDL Error: %s\n", SDL_GetError() );
+	}
+	else
+	{
+		mWidth = width;
+		mHeight = height;
+	}
+
+	return mTexture != NULL;
+}
+
+void LTexture::free()
+{
+	//Free texture if it exists
+	if( mTexture != NULL )
+	{
+		SDL_DestroyTexture( mTexture );
+		mTexture = NULL;
+		mWidth = 0;
+		mHeight = 0;
+	}
+}
+
+void LTexture::render( int x, int y, SDL_Rect* clip )
+{
+	//Set rendering space and render to screen
+	SDL_Rect renderQuad = { x, y, mWidth, mHeight };
+
+	//Set clip rendering dimensions
+	if( clip != NULL )
+	{
+		renderQuad.w = clip->w;
+		renderQuad.h = clip->h;
+	}
+
+	//Render to screen
+	SDL_RenderCopy( gRenderer, mTexture, clip, &renderQuad );
+}
+
+void LTexture::setAsRenderTarget()
+{
+	//Make self render target
+	SDL_SetRenderTarget( gRenderer, mTexture );
+}
+
+int LTexture::getWidth()
+{
+	return mWidth;
+}
+
+int LTexture::getHeight()
+{
+	return mHeight;
+}
+
+BoardTexture::BoardTexture()
+{
+    memset(drawn, 0, sizeof(drawn));
+    composed = false;
+}
+
+bool BoardTexture::create()
+{
+    composed = false;
+    if (!SDL_RenderTargetSupported(gRenderer))
+    {
+        return false;
+    }
+    return texture.createBlank(SCREEN_WIDTH, SCREEN_HEIGHT, SDL_TEXTUREACCESS_TARGET);
+}
+
+void BoardTexture::free()
+{
+    texture.free();
+    composed = false;
+}
+
+void BoardTexture::invalidate()
+{
+    composed = false;
+}
+
+void BoardTexture::renderTile(const Board& board, int index)
+{
+    int i = index / BOARD_COLUMNS;
+    int j = index % BOARD_COLUMNS;
+
+    //if tile has been crossed, use alt
+    if (board.getCrossed(index))
+    {
+        gSpriteSheetTexture.render(j * 8, i * 8, &gBoardPiecesAlt[i][j]);
+    }
+    else
+    {
+        gSpriteSheetTexture.render(j * 8, i * 8, &gBoardPieces[i][j]);
+    }
+}
+
+void BoardTexture::render(const Board& board)
+{
+    //no target texture, draw straight to the screen
+    if (texture.getWidth() == 0)
+    {
+        for (int i = 0; i < BOARD_TILES; i++)
+        {
+            renderTile(board, i);
+        }
+        return;
+    }
+
+    //diffing against what was drawn covers eating, rewinds, seeks and snapshots from the simulation thread alike
+    uint64_t crossed[BOARD_WORDS];
+    board.capture(crossed);
+    uint64_t changed[BOARD_WORDS];
+    for (int w = 0; w < BOARD_WORDS; w++)
+    {
+        changed[w] = crossed[w] ^ drawn[w];
+    }
+    memcpy(drawn, crossed, sizeof(drawn));
+
+    texture.setAsRenderTarget();
+    SDL_SetRenderDrawColor(gRenderer, 0, 0, 0, 255);
+    if (!composed)
+    {
+        SDL_RenderClear(gRenderer);
+        for (int i = 0; i < BOARD_TILES; i++)
+        {
+            renderTile(board, i);
+        }
+        composed = true;
+    }
+    else
+    {
+        for (int w = 0; w < BOARD_WORDS; w++)
+        {
+            while (changed[w])
+            {
+                int index = (w << 6) + lowestBit64(changed[w]);
+                changed[w] &= changed[w] - 1;
+
+                //sprite sheet is colour keyed, so wipe the old tile before drawing over it
+                SDL_Rect tile = { (index % BOARD_COLUMNS) * 8, (index / BOARD_COLUMNS) * 8, 8, 8 };
+                SDL_RenderFillRect(gRenderer, &tile);
+                renderTile(board, index);
+            }
+        }
+    }
+    SDL_SetRenderTarget(gRenderer, NULL);
+
+    texture.render(0, 0);
+}
+
+SoftRenderer::SoftRenderer()
+{
+    sheetWidth = 0;
+    sheetHeight = 0;
+    memset(drawn, 0, sizeof(drawn));
+    composed = false;
+    texture = NULL;
+}
+
+bool SoftRenderer::create(std::string path)
+{
+    free();
+
+    SDL_Surface* loadedSurface = IMG_Load(path.c_str());
+    if (loadedSurface == NULL)
+    {
+        printf("Unable to load image %s! SDL_image Error: %s\n", path.c_str(), IMG_GetError());
+        return false;
+    }
+
+    //one known layout, so the blits never need to look at the format
+    SDL_Surface* converted = SDL_ConvertSurfaceFormat(loadedSurface, SDL_PIXELFORMAT_ARGB8888, 0);
+    SDL_FreeSurface(loadedSurface);
+    if (converted == NULL)
+    {
+        printf("Unable to convert %s! SDL Error: %s\n", path.c_str(), SDL_GetError());
+        return false;
+    }
+
+    sheetWidth = converted->w;
+    sheetHeight = converted->h;
+    sheet.resize((size_t)sheetWidth * sheetHeight);
+    SDL_LockSurface(converted);
+    for (int y = 0; y < sheetHeight; y++)
+    {
+        memcpy(&sheet[(size_t)y * sheetWidth], (const uint8_t*)converted->pixels + (size_t)y * converted->pitch, sheetWidth * sizeof(uint32_t));
+    }
+    SDL_UnlockSurface(converted);
+    SDL_FreeSurface(converted);
+
+    texture = SDL_CreateTexture(gRenderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, SCREEN_WIDTH, SCREEN_HEIGHT);
+    if (texture == NULL)
+    {
+        printf("Unable to create streaming texture! SDL Error: %s\n", SDL_GetError());
+        free();
+        return false;
+    }
+    SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_NONE);
+
+    board.assign((size_t)SCREEN_WIDTH * SCREEN_HEIGHT, 0xFF000000);
+    frame.assign((size_t)SCREEN_WIDTH * SCREEN_HEIGHT, 0xFF000000);
+    composed = false;
+    return true;
+}
+
+void SoftRenderer::free()
+{
+    if (texture != NULL)
+    {
+        SDL_DestroyTexture(texture);
+        texture = NULL;
+    }
+    sheet.clear();
+    board.clear();
+    frame.clear();
+    sheetWidth = 0;
+    sheetHeight = 0;
+    composed = false;
+}
+
+bool SoftRenderer::isActive() const
+{
+    return texture != NULL;
+}
+
+void SoftRenderer::invalidate()
+{
+    composed = false;
+}
+
+void SoftRenderer::blitKeyed(uint32_t* dst, int dstPitch, const uint32_t* src, int srcPitch, int w, int h)
+{
+    for (int y = 0; y < h; y++, dst += dstPitch, src += srcPitch)
+    {
+        int x = 0;
+#ifdef PACMAN_SSE2
+        //four pixels at a time, a lane is kept from dst where the source colour is black
+        const __m128i rgb = _mm_set1_epi32(0x00FFFFFF);
+        const __m128i zero = _mm_setzero_si128();
+        for (; x + 4 <= w; x += 4)
+        {
+            __m128i s = _mm_loadu_si128((const __m128i*)(src + x));
+            __m128i d = _mm_loadu_si128((const __m128i*)(dst + x));
+            __m128i key = _mm_cmpeq_epi32(_mm_and_si128(s, rgb), zero);
+            _mm_storeu_si128((__m128i*)(dst + x), _mm_or_si128(_mm_and_si128(key, d), _mm_andnot_si128(key, s)));
+        }
+#endif
+        for (; x < w; x++)
+        {
+            if (src[x] & 0x00FFFFFF)
+            {
+                dst[x] = src[x];
+            }
+        }
+    }
+}
+
+void SoftRenderer::renderTile(const Board& board, int index)
+{
+    int i = index / BOARD_COLUMNS;
+    int j = index % BOARD_COLUMNS;
+    const SDL_Rect& clip = board.getCrossed(index) ? gBoardPiecesAlt[i][j] : gBoardPieces[i][j];
+
+    //wipe the old tile, the piece is colour keyed like everything else on the sheet
+    uint32_t* dst = &this->board[(size_t)(i * 8) * SCREEN_WIDTH + j * 8];
+    for (int y = 0; y < 8; y++)
+    {
+        std::fill(dst + y * SCREEN_WIDTH, dst + y * SCREEN_WIDTH + 8, 0xFF000000);
+    }
+    blitKeyed(dst, SCREEN_WIDTH, &sheet[(size_t)clip.y * sheetWidth + clip.x], sheetWidth, clip.w, clip.h);
+}
+
+void SoftRenderer::renderBoard(const Board& board)
+{
+    //diffing against the bits last drawn also catches rewinds and seeks, nothing has to mark tiles
+    uint64_t crossed[BOARD_WORDS];
+    board.capture(crossed);
+    if (!composed)
+    {
+        for (int i = 0; i < BOARD_TILES; i++)
+        {
+            renderTile(board, i);
+        }
+        composed = true;
+    }
+    else
+    {
+        for (int w = 0; w < BOARD_WORDS; w++)
+        {
+            for (uint64_t changed = crossed[w] ^ drawn[w]; changed; changed &= changed - 1)
+            {
+                renderTile(board, (w << 6) + lowestBit64(changed));
+            }
+        }
+    }
+    memcpy(drawn, crossed, sizeof(drawn));
+
+    memcpy(&frame[0], &this->board[0], frame.size() * sizeof(uint32_t));
+}
+
+void SoftRenderer::renderSprite(int x, int y, const SDL_Rect* clip)
+{
+    //clip against the frame, sprites hang off the edges in the tunnel
+    int left = std::max(0, -x);
+    int top = std::max(0, -y);
+    int right = std::min(clip->w, SCREEN_WIDTH - x);
+    int bottom = std::min(clip->h, SCREEN_HEIGHT - y);
+    if (left >= right || top >= bottom)
+    {
+        return;
+    }
+    blitKeyed(&frame[(size_t)(y + top) * SCREEN_WIDTH + x + left], SCREEN_WIDTH,
+              &sheet[(size_t)(clip->y + top) * sheetWidth + clip->x + left], sheetWidth, right - left, bottom - top);
+}
+
+void SoftRenderer::present()
+{
+    SDL_UpdateTexture(texture, NULL, &frame[0], SCREEN_WIDTH * sizeof(uint32_t));
+    SDL_RenderCopy(gRenderer, texture, NULL, NULL);
+}
+
+AudioMixer::AudioMixer()
+{
+    device = 0;
+    memset(&spec, 0, sizeof(spec));
+    memset(voices, 0, sizeof(voices));
+}
+
+bool AudioMixer::open()
+{
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO) < 0)
+    {
+        printf("SDL audio could not initialize! SDL Error: %s\n", SDL_GetError());
+        return false;
+    }
+
+    //mono 16-bit at a fixed rate, SDL converts for the hardware so the mixer never has to
+    SDL_AudioSpec wanted;
+    memset(&wanted, 0, sizeof(wanted));
+    wanted.freq = FREQUENCY;
+    wanted.format = AUDIO_S16SYS;
+    wanted.channels = 1;
+    wanted.samples = BUFFER_FRAMES;
+    wanted.callback = callback;
+    wanted.userdata = this;
+    device = SDL_OpenAudioDevice(NULL, 0, &wanted, &spec, 0);
+    if (device == 0)
+    {
+        printf("Unable to open audio device! SDL Error: %s\n", SDL_GetError());
+        SDL_QuitSubSystem(SDL_INIT_AUDIO);
+        return false;
+    }
+    return true;
+}
+
+bool AudioMixer::load(int sound, std::string path)
+{
+    SDL_AudioSpec wavSpec;
+    Uint8* wav = NULL;
+    Uint32 length = 0;
+    if (SDL_LoadWAV(path.c_str(), &wavSpec, &wav, &length) == NULL)
+    {
+        printf("Unable to load sound %s! SDL Error: %s\n", path.c_str(), SDL_GetError());
+        return false;
+    }
+
+    //converted once here, so the callback only ever adds samples
+    SDL_AudioCVT cvt;
+    if (SDL_BuildAudioCVT(&cvt, wavSpec.format, wavSpec.channels, wavSpec.freq, spec.format, spec.channels, spec.freq) < 0)
+    {
+        printf("Unable to convert sound %s! SDL Error: %s\n", path.c_str(), SDL_GetError());
+        SDL_FreeWAV(wav);
+        return false;
+    }
+    cvt.len = (int)length;
+    cvt.buf = (Uint8*)SDL_malloc((size_t)length * std::max(cvt.len_mult, 1));
+    memcpy(cvt.buf, wav, length);
+    SDL_FreeWAV(wav);
+    cvt.len_cvt = cvt.len;
+    if (cvt.needed && SDL_ConvertAudio(&cvt) < 0)
+    {
+        printf("Unable to convert sound %s! SDL Error: %s\n", path.c_str(), SDL_GetError());
+        SDL_free(cvt.buf);
+        return false;
+    }
+
+    clips[sound].assign((const int16_t*)cvt.buf, (const int16_t*)cvt.buf + cvt.len_cvt / sizeof(int16_t));
+    SDL_free(cvt.buf);
+    return true;
+}
+
+void AudioMixer::resume()
+{
+    SDL_PauseAudioDevice(device, 0);
+}
+
+void AudioMixer::close()
+{
+    if (device != 0)
+    {
+        SDL_CloseAudioDevice(device);
+        SDL_QuitSubSystem(SDL_INIT_AUDIO);
+        device = 0;
+    }
+    for (int i = 0; i < SOUNDS; i++)
+    {
+        clips[i].clear();
+    }
+    memset(voices, 0, sizeof(voices));
+}
+
+void AudioMixer::send(int sound, int command)
+{
+    Command c = { (uint8_t)sound, (uint8_t)command };
+    commands.push(c);
+}
+
+void AudioMixer::setClip(int sound, const std::vector<int16_t>& pcm)
+{
+    clips[sound] = pcm;
+}
+
+//adds n samples of src into dst, clamping instead of wrapping
+static void addSaturated(int16_t* dst, const int16_t* src, int n)
+{
+    int i = 0;
+#ifdef PACMAN_SSE2
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i sum = _mm_adds_epi16(_mm_loadu_si128((const __m128i*)(dst + i)), _mm_loadu_si128((const __m128i*)(src + i)));
+        _mm_storeu_si128((__m128i*)(dst + i), sum);
+    }
+#endif
+    for (; i < n; i++)
+    {
+        dst[i] = (int16_t)std::min(std::max(dst[i] + src[i], -32768), 32767);
+    }
+}
+
+void AudioMixer::mix(int16_t* out, int frames)
+{
+    //take whatever the game asked for since the last callback
+    Command c;
+    while (commands.pop(c))
+    {
+        Voice& voice = voices[c.sound];
+        if (c.command == SOUND_STOP)
+        {
+            voice.playing = false;
+        }
+        else
+        {
+            if (c.command == SOUND_PLAY || !voice.playing)
+            {
+                voice.position = 0;
+            }
+            voice.playing = true;
+            voice.looping = c.command == SOUND_LOOP;
+        }
+    }
+
+    memset(out, 0, frames * sizeof(int16_t));
+    for (int s = 0; s < SOUNDS; s++)
+    {
+        Voice& voice = voices[s];
+        int length = (int)clips[s].size();
+        int done = 0;
+        while (voice.playing && done < frames)
+        {
+            if (length == 0)
+            {
+                voice.playing = false;
+                break;
+            }
+            int n = std::min(frames - done, length - voice.position);
+            addSaturated(out + done, &clips[s][voice.position], n);
+            done += n;
+            voice.position += n;
+            if (voice.position == length)
+            {
+                voice.position = 0;
+                voice.playing = voice.looping;
+            }
+        }
+    }
+}
+
+void AudioMixer::callback(void* userdata, Uint8* stream, int length)
+{
+    ((AudioMixer*)userdata)->mix((int16_t*)stream, length / (int)sizeof(int16_t));
+}
+
+VideoWriter::VideoWriter()
+{
+    file = NULL;
+    png = false;
+    digits = 0;
+    failed = false;
+    stopping = false;
+    stalls = 0;
+}
+
+VideoWriter::~VideoWriter()
+{
+    if( isOpen() )
+    {
+        close();
+    }
+}
+
+bool VideoWriter::open( std::string p, int fps )
+{
+    path = p;
+    size_t percent = path.find( '%' );
+    png = percent != std::string::npos;
+    std::string extension = path.substr( path.size() - std::min( path.size(), (size_t)4 ) );
+    for( size_t i = 0; i < extension.size(); i++ )
+    {
+        extension[ i ] = (char)tolower( (unsigned char)extension[ i ] );
+    }
+    if( png )
+    {
+        //the path is never handed to printf, so only a plain zero padded number is understood
+        size_t end = percent + 1;
+        if( end < path.size() && path[ end ] == '0' )
+        {
+            end++;
+        }
+        digits = 0;
+        while( end < path.size() && isdigit( (unsigned char)path[ end ] ) && digits < 100 )
+        {
+            digits = digits * 10 + ( path[ end ] - '0' );
+            end++;
+        }
+        if( end >= path.size() || path[ end ] != 'd' || path.find( '%', end ) != std::string::npos || digits > 16 )
+        {
+            printf( "usage: pacman --export OUT, %s needs exactly one %%d or %%0Nd frame number and no other %%!\n", path.c_str() );
+            return false;
+        }
+        prefix = path.substr( 0, percent );
+        suffix = path.substr( end + 1 );
+    }
+    else if( extension == ".png" )
+    {
+        //a single name can't hold a PNG sequence, and a Y4M stream behind a .png name would only confuse
+        printf( "usage: pacman --export OUT, %s needs exactly one %%d or %%0Nd frame number and no other %%!\n", path.c_str() );
+        return false;
+    }
+    else
+    {
+        file = fopen( path.c_str(), "wb" );
+        if( file == NULL )
+        {
+            printf( "Unable to create video %s!\n", path.c_str() );
+            return false;
+        }
+
+        //full range BT.601 with chroma centred between each 2x2 block of pixels
+        if( fprintf( file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg XCOLORRANGE=FULL\n", SCREEN_WIDTH, SCREEN_HEIGHT, fps ) < 0 )
+        {
+            printf( "Unable to write video %s!\n", path.c_str() );
+            fclose( file );
+            file = NULL;
+            return false;
+        }
+    }
+
+    slots.assign( QUEUE_FRAMES, std::vector<uint32_t>( (size_t)SCREEN_WIDTH * SCREEN_HEIGHT ) );
+    queued.clear();
+    available.clear();
+    for( int i = 0; i < QUEUE_FRAMES; i++ )
+    {
+        available.push_back( i );
+    }
+    failed = false;
+    stopping = false;
+    stalls = 0;
+    thread = std::thread( &VideoWriter::work, this );
+    return true;
+}
+
+void VideoWriter::write( const uint32_t* pixels )
+{
+    int slot;
+    {
+        std::unique_lock<std::mutex> guard( lock );
+        if( available.empty() )
+        {
+            stalls++;
+            while( available.empty() )
+            {
+                space.wait( guard );
+            }
+        }
+        slot = available.back();
+        available.pop_back();
+    }
+
+    //copied outside the lock, nobody else touches a slot that is neither queued nor available
+    memcpy( &slots[ slot ][ 0 ], pixels, slots[ slot ].size() * sizeof( uint32_t ) );
+    {
+        std::lock_guard<std::mutex> guard( lock );
+        queued.push_back( slot );
+    }
+    wake.notify_one();
+}
+
+bool VideoWriter::close()
+{
+    {
+        std::lock_guard<std::mutex> guard( lock );
+        stopping = true;
+    }
+    wake.notify_one();
+    thread.join();
+
+    if( file != NULL )
+    {
+        if( fclose( file ) != 0 && !failed )
+        {
+            printf( "Unable to write video %s!\n", path.c_str() );
+            failed = true;
+        }
+        file = NULL;
+    }
+    return !failed;
+}
+
+void VideoWriter::work()
+{
+    int index = 0;
+    while( true )
+    {
+        int slot;
+        {
+            std::unique_lock<std::mutex> guard( lock );
+            while( queued.empty() && !stopping )
+            {
+                wake.wait( guard );
+            }
+            if( queued.empty() )
+            {
+                return;
+            }
+            slot = queued.front();
+            queued.pop_front();
+        }
+
+        //once a write has failed the rest are dropped, close reports it
+        if( !failed )
+        {
+            if( png )
+            {
+                writePNG( &slots[ slot ][ 0 ], index );
+            }
+            else
+            {
+                writeY4M( &slots[ slot ][ 0 ] );
+            }
+        }
+        index++;
+
+        {
+            std::lock_guard<std::mutex> guard( lock );
+            available.push_back( slot );
+        }
+        space.notify_one();
+    }
+}
+
+void VideoWriter::writeY4M( const uint32_t* pixels )
+{
+    const int chromaWidth = SCREEN_WIDTH / 2;
+    const int chromaHeight = SCREEN_HEIGHT / 2;
+    planes.resize( (size_t)SCREEN_WIDTH * SCREEN_HEIGHT + 2 * chromaWidth * chromaHeight );
+    uint8_t* luma = &planes[ 0 ];
+    uint8_t* cb = luma + SCREEN_WIDTH * SCREEN_HEIGHT;
+    uint8_t* cr = cb + chromaWidth * chromaHeight;
+
+    //8-bit fixed point, weights summing to 256 so white stays 255
+    for( int i = 0; i < SCREEN_WIDTH * SCREEN_HEIGHT; i++ )
+    {
+        int r = ( pixels[ i ] >> 16 ) & 255;
+        int g = ( pixels[ i ] >> 8 ) & 255;
+        int b = pixels[ i ] & 255;
+        luma[ i ] = (uint8_t)( ( 77 * r + 150 * g + 29 * b ) >> 8 );
+    }
+    for( int y = 0; y < chromaHeight; y++ )
+    {
+        for( int x = 0; x < chromaWidth; x++ )
+        {
+            const uint32_t* p = pixels + ( 2 * y ) * SCREEN_WIDTH + 2 * x;
+            uint32_t q[ 4 ] = { p[ 0 ], p[ 1 ], p[ SCREEN_WIDTH ], p[ SCREEN_WIDTH + 1 ] };
+            int r = 0;
+            int g = 0;
+            int b = 0;
+            for( int k = 0; k < 4; k++ )
+            {
+                r += ( q[ k ] >> 16 ) & 255;
+                g += ( q[ k ] >> 8 ) & 255;
+                b += q[ k ] & 255;
+            }
+            cb[ y * chromaWidth + x ] = (uint8_t)( ( ( -43 * r - 85 * g + 128 * b ) >> 10 ) + 128 );
+            cr[ y * chromaWidth + x ] = (uint8_t)( ( ( 128 * r - 107 * g - 21 * b ) >> 10 ) + 128 );
+        }
+    }
+
+    if( fputs( "FRAME\n", file ) == EOF || fwrite( &planes[ 0 ], 1, planes.size(), file ) != planes.size() )
+    {
+        printf( "Unable to write video %s!\n", path.c_str() );
+        failed = true;
+    }
+}
+
+void VideoWriter::writePNG( const uint32_t* pixels, int index )
+{
+    char number[ 32 ];
+    snprintf( number, sizeof( number ), "%0*d", digits, index );
+    if( !saveFramePNG( prefix + number + suffix, pixels ) )
+    {
+        failed = true;
+    }
+}
+
+Entity::Entity()
+{
+    xLoc = 0;
+    yLoc = 0;
+    orientation = DEFAULT;
+    nextTurn = DEFAULT;
+    mouthOpen = true;
+    scatterMode = false;
+    fleeMode = false;
+    eaten = false;
+}
+
+Entity::~Entity()
+{
+    //Deallocate entity
+    free();
+}
+
+void Entity::free()
+{
+    xLoc = 0;
+    yLoc = 0;
+    orientation = 0;
+    mouthOpen = 0;
+}
+
+void Entity::update(const World& world)
+{
+    const Board& b = world.getBoard();
+
+    //Changes mouth to open or closed, or the other way
+    setMouthOpen(!getMouthOpen());
+
+    //Moves entity coordinates based on direction of movement
+    //entity will traverse exactly one tile (8 pixels) at a time
+    //distances are offset by starting location
+    int xTile = (getXLoc() - 4) / 8;
+    int yTile = (getYLoc() - 4) / 8;
+
+    //removes eaten status at start tile
+    if (xTile == 13 && yTile == 11)
+    {
+        eaten = false;
+    }
+
+    for(int i = 0; i < 2; i++)
+    {
+        switch(getOrientation())
+        {
+        //max added for wraparound
+        case(RIGHT):
+        if (b.getTile(yTile, std::max(xTile, 0)).canGoRight() || ((getXLoc()- 15) % 8 != 0) || ((getYLoc() - 13) % 8 != 0))
+        {
+            setXLoc(getXLoc() + 1);
+        }
+        break;
+
+        //min added for wraparound
+        case(LEFT):
+        if (b.getTile(yTile, std::min(xTile, 27)).canGoLeft() || ((getXLoc() - 15) % 8 != 0) || ((getYLoc() - 13) % 8 != 0))
+        {
+            setXLoc(getXLoc() - 1);
+        }
+        break;
+
+        case(UP):
+        if (b.getTile(yTile, xTile).canGoUp() || ((getXLoc() - 15) % 8 != 0) || ((getYLoc() - 13) % 8 != 0))
+        {
+            setYLoc(getYLoc() - 1);
+        }
+        break;
+
+        case(DOWN):
+        if (b.getTile(yTile, xTile).canGoDown() || ((getXLoc() - 15) % 8 != 0) || ((getYLoc() - 13) % 8 != 0))
+        {
+            setYLoc(getYLoc() + 1);
+        }
+        break;
+
+        default:
+        break;
+        }
+    }
+
+    //wrap around
+    if (getXLoc() > 224)
+    {
+        setXLoc(-1);
+    }
+    else if (getXLoc() < 0)
+    {
+        setXLoc(221);
+    }
+
+    //reset theser variables
+    yTile = (getYLoc() - 4) / 8;
+    xTile = (getXLoc() - 4) / 8;
+
+    //change direction if you can
+    //direction will be changed as soon as entity is fully on a tile that can exit in that direction
+    if ((getXLoc() - 15) % 8 == 0 && (getYLoc() - 13) % 8 == 0)
+    {
+        switch(nextTurn)
+        {
+            case(UP):
+            if (b.getTile(yTile, xTile).canGoUp())
+            {
+                setOrientation(UP);
+            }
+            break;
+            case(DOWN):
+            if (b.getTile(yTile, xTile).canGoDown())
+            {
+                setOrientation(DOWN);
+            }
+            break;
+            case(LEFT):
+            if (b.getTile(yTile, xTile).canGoLeft())
+            {
+                setOrientation(LEFT);
+            }
+            break;
+            case(RIGHT):
+            if (b.getTile(yTile, xTile).canGoRight())
+            {
+                setOrientation(RIGHT);
+            }
+            break;
+            default:
+            break;
+        }
+    }
+}
+
+void Entity::setXLoc(int x)
+{
+    xLoc = x;
+}
+
+void Entity::setYLoc(int y)
+{
+    yLoc = y;
+}
+
+void Entity::setOrientation(int dir)
+{
+    orientation = dir;
+}
+
+int Entity::getXLoc() const
+{
+    return xLoc;
+}
+
+int Entity::getYLoc() const
+{
+    return yLoc;
+}
+
+int Entity::getOrientation() const
+{
+    return orientation;
+}
+
+bool Entity::getMouthOpen() const
+{
+    return mouthOpen;
+}
+
+void Entity::setMouthOpen(bool b)
+{
+    mouthOpen = b;
+}
+
+int Entity::currentSprite() const
+{
+    return (getOrientation() * 2) + mouthOpen;
+}
+
+void Entity::setNextTurn(int turn)
+{
+    nextTurn = turn;
+}
+
+void Entity::capture(EntityState& state) const
+{
+    state.xLoc = (int16_t)xLoc;
+    state.yLoc = (int16_t)yLoc;
+    state.orientation = (int8_t)orientation;
+    state.nextTurn = (int8_t)nextTurn;
+    state.flags = (mouthOpen ? MOUTH_OPEN : 0) | (scatterMode ? SCATTER : 0) | (fleeMode ? FLEE : 0) | (eaten ? EATEN : 0);
+    state.death = 0;
+}
+
+void Entity::restore(const EntityState& state)
+{
+    xLoc = state.xLoc;
+    yLoc = state.yLoc;
+    orientation = state.orientation;
+    nextTurn = state.nextTurn;
+    mouthOpen = (state.flags & MOUTH_OPEN) != 0;
+    scatterMode = (state.flags & SCATTER) != 0;
+    fleeMode = (state.flags & FLEE) != 0;
+    eaten = (state.flags & EATEN) != 0;
+}
+
+Blinky::Blinky()
+{
+    //spawns near ghost house
+    setXLoc(111);
+    setYLoc(93);
+    setOrientation(UP);
+}
+
+Pinky::Pinky()
+{
+    setXLoc(127);
+    setYLoc(93);
+    setOrientation(UP);
+}
+
+Inky::Inky()
+{
+    setXLoc(143);
+    setYLoc(93);
+    setOrientation(UP);
+}
+
+Clyde::Clyde()
+{
+    setXLoc(159);
+    setYLoc(93);
+    setOrientation(UP);
+}
+
+//tile reached by leaving index in direction dir, wrapping through the tunnel
+static int neighbourTile(int index, int dir)
+{
+    int i = index / BOARD_COLUMNS;
+    int j = index % BOARD_COLUMNS;
+    switch (dir)
+    {
+        case RIGHT:
+        return i * BOARD_COLUMNS + (j + 1) % BOARD_COLUMNS;
+        case LEFT:
+        return i * BOARD_COLUMNS + (j + BOARD_COLUMNS - 1) % BOARD_COLUMNS;
+        case UP:
+        return index - BOARD_COLUMNS;
+        case DOWN:
+        return index + BOARD_COLUMNS;
+        default:
+        return index;
+    }
+}
+
+//direction that undoes dir
+static int reverseOf(int dir)
+{
+    return dir == DEFAULT ? DEFAULT : dir ^ 1;
+}
+
+//Ghost targeting policies, each knows a scatter corner and a chase goal
+//the steering kernel below is stamped out once per policy, no virtual calls involved
+
+//blinky goes straight for the player
+struct ChaseTarget
+{
+    enum { SCATTER_Y = 0, SCATTER_X = 27 };
+
+    static void chase(const Entity& /*ghost*/, const World& world, int& goalY, int& goalX)
+    {
+        const Player& p = world.getPlayer();
+        goalY = (p.getYLoc() - 4) / 8;
+        goalX = (p.getXLoc() - 4) / 8;
+    }
+};
+
+//pinky aims four tiles in front of the player's mouth
+struct AmbushTarget
+{
+    enum { SCATTER_Y = 0, SCATTER_X = 0 };
+
+    static void chase(const Entity& /*ghost*/, const World& world, int& goalY, int& goalX)
+    {
+        const Player& p = world.getPlayer();
+        goalY = (p.getYLoc() - 4) / 8;
+        goalX = (p.getXLoc() - 4) / 8;
+
+        switch(p.getOrientation())
+        {
+            case LEFT:
+                goalX -= 4;
+                break;
+            case RIGHT:
+                goalX += 4;
+                break;
+            case UP:
+                goalY -= 4;
+                break;
+            case DOWN:
+                goalY += 4;
+                break;
+            default:
+                break;
+        }
+    }
+};
+
+//inky doubles the vector from blinky to two tiles in front of the player
+struct BlinkyVectorTarget
+{
+    enum { SCATTER_Y = 30, SCATTER_X = 0 };
+
+    static void chase(const Entity& /*ghost*/, const World& world, int& goalY, int& goalX)
+    {
+        const Player& p = world.getPlayer();
+        goalY = (p.getYLoc() - 4) / 8;
+        goalX = (p.getXLoc() - 4) / 8;
+
+        switch(p.getOrientation())
+        {
+            case LEFT:
+                goalX -= 2;
+                break;
+            case RIGHT:
+                goalX += 2;
+                break;
+            case UP:
+                goalY -= 2;
+                break;
+            case DOWN:
+                goalY += 2;
+                break;
+            default:
+                break;
+        }
+
+        //blinky's location is in pixels, as it always has been
+        goalX += (goalX - world.getBlinky().getXLoc());
+        goalY += (goalY - world.getBlinky().getYLoc());
+    }
+};
+
+//clyde chases like blinky until he gets within 8 tiles, then heads for his corner
+struct ClydeTarget
+{
+    enum { SCATTER_Y = 30, SCATTER_X = 27 };
+
+    static void chase(const Entity& ghost, const World& world, int& goalY, int& goalX)
+    {
+        ChaseTarget::chase(ghost, world, goalY, goalX);
+        int dy = goalY - (ghost.getYLoc() - 4) / 8;
+        int dx = goalX - (ghost.getXLoc() - 4) / 8;
+        if (dy * dy + dx * dx < 8 * 8)
+        {
+            goalY = SCATTER_Y;
+            goalX = SCATTER_X;
+        }
+    }
+};
+
+//turn a ghost following Policy should take next
+//ghosts can only turn in 90 degree angles and only think one space ahead
+template <class Policy>
+int steerGhost(const Entity& ghost, const World& world)
+{
+    int yTile = (ghost.getYLoc() - 4) / 8;
+    int xTile = (ghost.getXLoc() - 4) / 8;
+    int index = yTile * BOARD_COLUMNS + xTile;
+
+    //in a corridor there is only one way on, no need to look for the goal
+    int forced = gJunctionGraph.corridorTurn(index, ghost.getOrientation());
+    if (forced != JunctionGraph::CHOICE)
+    {
+        return forced;
+    }
+
+    //eaten ghosts head home, scattering ghosts head for their corner
+    int goalY;
+    int goalX;
+    if (ghost.getEaten())
+    {
+        goalY = 11;
+        goalX = 13;
+    }
+    else if (ghost.getScatter() && !ghost.getFlee())
+    {
+        goalY = Policy::SCATTER_Y;
+        goalX = Policy::SCATTER_X;
+    }
+    else
+    {
+        Policy::chase(ghost, world, goalY, goalX);
+    }
+    bool flee = ghost.getFlee() && !ghost.getEaten();
+
+    //follow the true shortest path instead of the arcade heuristic
+    if (world.getGhostAI() == PATH_AI)
+    {
+        return pathTable().steer(index, ghost.getOrientation(), goalY, goalX, flee);
+    }
+
+    //score the four neighbours in one pass, ties go down, up, left, right
+    //the thresholds keep the arcade quirk of comparing against the current distance +-5
+    static const int order[4] = { DOWN, UP, LEFT, RIGHT };
+    static const int stepY[4] = { 1, -1, 0, 0 };
+    static const int stepX[4] = { 0, 0, -1, 1 };
+    int candidates = world.getBoard().getExits(index) & ~(1 << reverseOf(ghost.getOrientation()));
+    int best = DEFAULT;
+    int worst = DEFAULT;
+    int bestHamilton = abs(goalY - yTile) + abs(goalX - xTile) + 5;
+    int worstHamilton = bestHamilton - 10;
+    for (int k = 0; k < 4; k++)
+    {
+        int valid = (candidates >> order[k]) & 1;
+        int hypotheticalDistance = abs(goalY - (yTile + stepY[k])) + abs(goalX - (xTile + stepX[k]));
+        bool better = valid && hypotheticalDistance < bestHamilton;
+        bool worse = valid && hypotheticalDistance > worstHamilton;
+        best = better ? order[k] : best;
+        bestHamilton = better ? hypotheticalDistance : bestHamilton;
+        worst = worse ? order[k] : worst;
+        worstHamilton = worse ? hypotheticalDistance : worstHamilton;
+    }
+    return flee ? worst : best;
+}
+
+void Blinky::decideTurn(const World& world)
+{
+    setNextTurn(steerGhost<ChaseTarget>(*this, world));
+}
+
+void Pinky::decideTurn(const World& world)
+{
+    setNextTurn(steerGhost<AmbushTarget>(*this, world));
+}
+
+void Inky::decideTurn(const World& world)
+{
+    setNextTurn(steerGhost<BlinkyVectorTarget>(*this, world));
+}
+
+void Clyde::decideTurn(const World& world)
+{
+    setNextTurn(steerGhost<ClydeTarget>(*this, world));
+}
+
+Board::Board()
+{
+    //the maze itself is compiled in, only the pellets need setting up
+    memset(crossed, 0, sizeof(crossed));
+}
+
+int Board::updateBoard(const Player& p)
+{
+    //finds tile player is on
+    int xTile = p.getXLoc() / 8;
+    int yTile = p.getYLoc() / 8;
+    int index = yTile * BOARD_COLUMNS + xTile;
+
+    //crosses off that tile if it has not been
+    if (getCrossed(index))
+    {
+        return -1;
+    }
+    crossOff(index);
+    return index;
+}
+
+Tile Board::getTile(int i, int j) const
+{
+    return Tile(this, i * BOARD_COLUMNS + j);
+}
+
+int Board::pelletsLeft() const
+{
+    int count = 0;
+    for (int i = 0; i < BOARD_WORDS; i++)
+    {
+        count += popcount64(MAZE.walkable[i] & ~crossed[i]);
+    }
+    return count;
+}
+
+bool Board::allEaten() const
+{
+    uint64_t left = 0;
+    for (int i = 0; i < BOARD_WORDS; i++)
+    {
+        left |= MAZE.walkable[i] & ~crossed[i];
+    }
+    return left == 0;
+}
+
+PathTable::PathTable()
+{
+    memset(distance, UNREACHABLE, sizeof(distance));
+    memset(nextHop, DEFAULT, sizeof(nextHop));
+
+    //ties go the same way as the arcade heuristic: down, up, left, right
+    const int order[4] = { DOWN, UP, LEFT, RIGHT };
+
+    int queue[BOARD_TILES];
+    for (int to = 0; to < BOARD_TILES; to++)
+    {
+        if (!mazeExits(MAZE, to / BOARD_COLUMNS, to % BOARD_COLUMNS))
+        {
+            continue;
+        }
+
+        //exits are symmetric, so searching outwards from the goal finds the way in to it
+        uint8_t* dist = distance[to];
+        int head = 0;
+        int tail = 0;
+        dist[to] = 0;
+        queue[tail++] = to;
+        while (head < tail)
+        {
+            int tile = queue[head++];
+            int exits = mazeExits(MAZE, tile / BOARD_COLUMNS, tile % BOARD_COLUMNS);
+            for (int k = 0; k < 4; k++)
+            {
+                int next = neighbourTile(tile, order[k]);
+                if (((exits >> order[k]) & 1) && dist[next] == UNREACHABLE)
+                {
+                    dist[next] = (uint8_t)(dist[tile] + 1 < UNREACHABLE ? dist[tile] + 1 : UNREACHABLE - 1);
+                    queue[tail++] = next;
+                }
+            }
+        }
+
+        //first step is towards any neighbour one closer
+        for (int from = 0; from < BOARD_TILES; from++)
+        {
+            if (dist[from] == UNREACHABLE || from == to)
+            {
+                continue;
+            }
+            int exits = mazeExits(MAZE, from / BOARD_COLUMNS, from % BOARD_COLUMNS);
+            for (int k = 0; k < 4; k++)
+            {
+                if (((exits >> order[k]) & 1) && dist[neighbourTile(from, order[k])] + 1 == dist[from])
+                {
+                    nextHop[to][from] = (uint8_t)order[k];
+                    break;
+                }
+            }
+        }
+    }
+
+    //goals on walls or off the board are pulled onto the closest path
+    for (int index = 0; index < BOARD_TILES; index++)
+    {
+        int best = -1;
+        int bestDistance = 0;
+        for (int tile = 0; tile < BOARD_TILES; tile++)
+        {
+            if (!mazeExits(MAZE, tile / BOARD_COLUMNS, tile % BOARD_COLUMNS))
+            {
+                continue;
+            }
+            int d = abs(tile / BOARD_COLUMNS - index / BOARD_COLUMNS) + abs(tile % BOARD_COLUMNS - index % BOARD_COLUMNS);
+            if (best < 0 || d < bestDistance)
+            {
+                best = tile;
+                bestDistance = d;
+            }
+        }
+        nearest[index] = (int16_t)best;
+    }
+}
+
+int PathTable::nearestWalkable(int goalY, int goalX) const
+{
+    goalY = std::min(std::max(goalY, 0), BOARD_ROWS - 1);
+    goalX = std::min(std::max(goalX, 0), BOARD_COLUMNS - 1);
+    return nearest[goalY * BOARD_COLUMNS + goalX];
+}
+
+int PathTable::steer(int from, int orientation, int goalY, int goalX, bool flee) const
+{
+    int to = nearestWalkable(goalY, goalX);
+    const uint8_t* dist = distance[to];
+    if (from < 0 || from >= BOARD_TILES || dist[from] == UNREACHABLE)
+    {
+        return DEFAULT;
+    }
+
+    //the precomputed first step, as long as it isn't a u-turn
+    int hop = nextHop[to][from];
+    if (!flee && hop != DEFAULT && hop != reverseOf(orientation))
+    {
+        return hop;
+    }
+
+    //otherwise pick the best of the exits that don't turn back
+    const int order[4] = { DOWN, UP, LEFT, RIGHT };
+    int exits = mazeExits(MAZE, from / BOARD_COLUMNS, from % BOARD_COLUMNS);
+    int best = DEFAULT;
+    int bestDistance = flee ? -1 : UNREACHABLE + 1;
+    for (int k = 0; k < 4; k++)
+    {
+        int dir = order[k];
+        if (!((exits >> dir) & 1) || dir == reverseOf(orientation))
+        {
+            continue;
+        }
+        int d = dist[neighbourTile(from, dir)];
+        if (flee ? d > bestDistance : d < bestDistance)
+        {
+            best = dir;
+            bestDistance = d;
+        }
+    }
+    return best;
+}
+
+JunctionGraph::JunctionGraph()
+{
+    //a tile needs a decision when more than one exit doesn't turn back
+    for (int index = 0; index < BOARD_TILES; index++)
+    {
+        int exits = mazeExits(MAZE, index / BOARD_COLUMNS, index % BOARD_COLUMNS);
+        for (int orientation = 0; orientation <= DEFAULT; orientation++)
+        {
+            int ahead = orientation == DEFAULT ? exits : exits & ~(1 << reverseOf(orientation));
+            if (ahead == 0)
+            {
+                forced[index][orientation] = DEFAULT;
+            }
+            else if (popcount64(ahead) == 1)
+            {
+                forced[index][orientation] = (int8_t)lowestBit64(ahead);
+            }
+            else
+            {
+                forced[index][orientation] = CHOICE;
+            }
+        }
+
+        node[index] = -1;
+        if (popcount64(exits) >= 3)
+        {
+            node[index] = (int16_t)tiles.size();
+            tiles.push_back((int16_t)index);
+        }
+    }
+
+    //follow each exit of each junction until the next junction
+    edges.resize(tiles.size() * 4);
+    for (size_t n = 0; n < tiles.size(); n++)
+    {
+        int exits = mazeExits(MAZE, tiles[n] / BOARD_COLUMNS, tiles[n] % BOARD_COLUMNS);
+        for (int dir = 0; dir < 4; dir++)
+        {
+            Edge& edge = edges[n * 4 + dir];
+            edge.to = -1;
+            edge.length = 0;
+            if (!((exits >> dir) & 1))
+            {
+                continue;
+            }
+
+            int tile = neighbourTile(tiles[n], dir);
+            int heading = dir;
+            int length = 1;
+            while (node[tile] < 0 && length <= BOARD_TILES)
+            {
+                heading = forced[tile][heading];
+                if (heading == DEFAULT || heading == CHOICE)
+                {
+                    //dead end
+                    break;
+                }
+                tile = neighbourTile(tile, heading);
+                length++;
+            }
+            if (node[tile] >= 0)
+            {
+                edge.to = node[tile];
+                edge.length = (int16_t)length;
+            }
+        }
+    }
+}
+
+EntityStore::EntityStore()
+{
+    count = 0;
+}
+
+int EntityStore::add(int x, int y, int dir)
+{
+    int slot = count++;
+    size_t padded = (size_t)((count + 3) & ~3);
+    xLoc.resize(padded, 15);
+    yLoc.resize(padded, 13);
+    orientation.resize(padded, DEFAULT);
+    nextTurn.resize(padded, DEFAULT);
+    flags.resize(padded, MOUTH_OPEN);
+    exits.resize(padded, 0);
+
+    xLoc[slot] = x;
+    yLoc[slot] = y;
+    orientation[slot] = dir;
+    nextTurn[slot] = DEFAULT;
+    flags[slot] = MOUTH_OPEN;
+    return slot;
+}
+
+void EntityStore::updateScalar(const Board& board, int begin, int end)
+{
+    for (int i = begin; i < end; i++)
+    {
+        int x = xLoc[i];
+        int y = yLoc[i];
+        int dir = orientation[i];
+
+        //mouth flips, eaten ghosts recover on the start tile
+        int xTile = std::max(x - 4, 0) >> 3;
+        int yTile = std::max(y - 4, 0) >> 3;
+        flags[i] ^= MOUTH_OPEN;
+        if (xTile == 13 && yTile == 11)
+        {
+            flags[i] &= ~EATEN;
+        }
+
+        //two pixels a step, walls only stop entities at a tile centre
+        int open = (board.getExits(yTile * BOARD_COLUMNS + xTile) >> dir) & 1;
+        int dx = (dir == RIGHT) - (dir == LEFT);
+        int dy = (dir == DOWN) - (dir == UP);
+        for (int k = 0; k < 2; k++)
+        {
+            int move = open | ((((x - 15) | (y - 13)) & 7) != 0);
+            x += dx * move;
+            y += dy * move;
+        }
+
+        //wrap around
+        x = x > 224 ? -1 : (x < 0 ? 221 : x);
+
+        //turn as soon as the entity is fully on a tile that can exit that way
+        int turn = nextTurn[i];
+        bool centred = (((x - 15) | (y - 13)) & 7) == 0;
+        int tile = (std::max(y - 4, 0) >> 3) * BOARD_COLUMNS + (std::max(x - 4, 0) >> 3);
+        if (centred && turn != DEFAULT && ((board.getExits(tile) >> turn) & 1))
+        {
+            dir = turn;
+        }
+
+        xLoc[i] = x;
+        yLoc[i] = y;
+        orientation[i] = dir;
+    }
+}
+
+#ifdef PACMAN_SSE2
+//(v - 4) / 8 as Entity::update computes it, for v >= -1
+static inline __m128i tileOf(__m128i v)
+{
+    v = _mm_sub_epi32(v, _mm_set1_epi32(4));
+    v = _mm_andnot_si128(_mm_srai_epi32(v, 31), v);
+    return _mm_srli_epi32(v, 3);
+}
+
+//row * 28 + column without SSE4.1's 32 bit multiply
+static inline __m128i tileIndexOf(__m128i x, __m128i y)
+{
+    __m128i row = tileOf(y);
+    __m128i row28 = _mm_add_epi32(_mm_add_epi32(_mm_slli_epi32(row, 4), _mm_slli_epi32(row, 3)), _mm_slli_epi32(row, 2));
+    return _mm_add_epi32(row28, tileOf(x));
+}
+
+//1 << dir per lane, 0 for DEFAULT
+static inline __m128i directionBit(__m128i dir)
+{
+    __m128i bit = _mm_and_si128(_mm_cmpeq_epi32(dir, _mm_set1_epi32(RIGHT)), _mm_set1_epi32(1 << RIGHT));
+    bit = _mm_or_si128(bit, _mm_and_si128(_mm_cmpeq_epi32(dir, _mm_set1_epi32(LEFT)), _mm_set1_epi32(1 << LEFT)));
+    bit = _mm_or_si128(bit, _mm_and_si128(_mm_cmpeq_epi32(dir, _mm_set1_epi32(UP)), _mm_set1_epi32(1 << UP)));
+    return _mm_or_si128(bit, _mm_and_si128(_mm_cmpeq_epi32(dir, _mm_set1_epi32(DOWN)), _mm_set1_epi32(1 << DOWN)));
+}
+
+//all ones in lanes where the entity sits exactly on a tile centre
+static inline __m128i centred(__m128i x, __m128i y)
+{
+    __m128i off = _mm_or_si128(_mm_sub_epi32(x, _mm_set1_epi32(15)), _mm_sub_epi32(y, _mm_set1_epi32(13)));
+    return _mm_cmpeq_epi32(_mm_and_si128(off, _mm_set1_epi32(7)), _mm_setzero_si128());
+}
+
+static inline __m128i selectLanes(__m128i mask, __m128i a, __m128i b)
+{
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+#endif
+
+void EntityStore::update(const Board& board)
+{
+#ifdef PACMAN_SSE2
+    //padding lanes are updated along with the rest and simply ignored
+    int padded = (count + 3) & ~3;
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi32(1);
+
+    //pass 1: mouths, eaten recovery and the tile each entity starts on
+    for (int i = 0; i < padded; i += 4)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i*)&xLoc[i]);
+        __m128i y = _mm_loadu_si128((const __m128i*)&yLoc[i]);
+        __m128i f = _mm_xor_si128(_mm_loadu_si128((const __m128i*)&flags[i]), _mm_set1_epi32(MOUTH_OPEN));
+        __m128i home = _mm_and_si128(_mm_cmpeq_epi32(tileOf(x), _mm_set1_epi32(13)), _mm_cmpeq_epi32(tileOf(y), _mm_set1_epi32(11)));
+        f = _mm_andnot_si128(_mm_and_si128(home, _mm_set1_epi32(EATEN)), f);
+        _mm_storeu_si128((__m128i*)&flags[i], f);
+        _mm_storeu_si128((__m128i*)&exits[i], tileIndexOf(x, y));
+    }
+    for (int i = 0; i < padded; i++)
+    {
+        exits[i] = board.getExits(exits[i]);
+    }
+
+    //pass 2: two pixel steps and wraparound
+    for (int i = 0; i < padded; i += 4)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i*)&xLoc[i]);
+        __m128i y = _mm_loadu_si128((const __m128i*)&yLoc[i]);
+        __m128i dir = _mm_loadu_si128((const __m128i*)&orientation[i]);
+        __m128i open = _mm_cmpeq_epi32(_mm_and_si128(_mm_loadu_si128((const __m128i*)&exits[i]), directionBit(dir)), zero);
+        open = _mm_xor_si128(open, _mm_set1_epi32(-1));
+        __m128i dx = _mm_sub_epi32(_mm_and_si128(_mm_cmpeq_epi32(dir, _mm_set1_epi32(RIGHT)), one),
+                                   _mm_and_si128(_mm_cmpeq_epi32(dir, _mm_set1_epi32(LEFT)), one));
+        __m128i dy = _mm_sub_epi32(_mm_and_si128(_mm_cmpeq_epi32(dir, _mm_set1_epi32(DOWN)), one),
+                                   _mm_and_si128(_mm_cmpeq_epi32(dir, _mm_set1_epi32(UP)), one));
+        for (int k = 0; k < 2; k++)
+        {
+            __m128i move = _mm_or_si128(open, _mm_xor_si128(centred(x, y), _mm_set1_epi32(-1)));
+            x = _mm_add_epi32(x, _mm_and_si128(dx, move));
+            y = _mm_add_epi32(y, _mm_and_si128(dy, move));
+        }
+        __m128i past = _mm_cmpgt_epi32(x, _mm_set1_epi32(224));
+        __m128i before = _mm_cmplt_epi32(x, zero);
+        x = selectLanes(past, _mm_set1_epi32(-1), selectLanes(before, _mm_set1_epi32(221), x));
+        _mm_storeu_si128((__m128i*)&xLoc[i], x);
+        _mm_storeu_si128((__m128i*)&yLoc[i], y);
+        _mm_storeu_si128((__m128i*)&exits[i], tileIndexOf(x, y));
+    }
+    for (int i = 0; i < padded; i++)
+    {
+        exits[i] = board.getExits(exits[i]);
+    }
+
+    //pass 3: take queued turns at tile centres
+    for (int i = 0; i < padded; i += 4)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i*)&xLoc[i]);
+        __m128i y = _mm_loadu_si128((const __m128i*)&yLoc[i]);
+        __m128i dir = _mm_loadu_si128((const __m128i*)&orientation[i]);
+        __m128i turn = _mm_loadu_si128((const __m128i*)&nextTurn[i]);
+        __m128i blocked = _mm_cmpeq_epi32(_mm_and_si128(_mm_loadu_si128((const __m128i*)&exits[i]), directionBit(turn)), zero);
+        __m128i apply = _mm_andnot_si128(blocked, centred(x, y));
+        _mm_storeu_si128((__m128i*)&orientation[i], selectLanes(apply, turn, dir));
+    }
+#else
+    updateScalar(board, 0, count);
+#endif
+}
+
+Game::Game(int ai)
+{
+    ghostAI = ai;
+    frame = 0;
+    fleeFrame = frame;
+    crossedTile = -1;
+    events = 0;
+}
+
+bool Game::nearPellet() const
+{
+    //the same tile Board::updateBoard crosses off, and the one after it
+    int xTile = player.getXLoc() / 8;
+    int yTile = player.getYLoc() / 8;
+    int orientation = player.getOrientation();
+    int aheadX = xTile + (orientation == RIGHT) - (orientation == LEFT);
+    int aheadY = yTile + (orientation == DOWN) - (orientation == UP);
+
+    //nothing to eat in the tunnel
+    if (xTile < 0 || xTile >= BOARD_COLUMNS || aheadX < 0 || aheadX >= BOARD_COLUMNS || aheadY < 0 || aheadY >= BOARD_ROWS)
+    {
+        return false;
+    }
+    return board.hasPellet(yTile * BOARD_COLUMNS + xTile) || board.hasPellet(aheadY * BOARD_COLUMNS + aheadX);
+}
+
+bool Game::step()
+{
+    //view of the world shared by movement and ghost ai
+    World world(board, player, blinky, ghostAI);
+    bool over = false;
+    events = 0;
+
+    //Update board
+    {
+        PROFILE_SCOPE(PROFILE_BOARD_UPDATE);
+        crossedTile = board.updateBoard(player);
+    }
+
+    //check if energizer is eaten
+    int xTile = (player.getXLoc() - 4) / 8;
+    int yTile = (player.getYLoc() - 4) / 8;
+    if (yTile == 3 && (xTile == 1 || xTile == 26))
+    {
+        blinky.setFlee(true);
+        pinky.setFlee(true);
+        inky.setFlee(true);
+        //only the first frame on the energizer counts as eating it
+        if (fleeFrame != frame - 1)
+        {
+            events |= GAME_ENERGIZER;
+        }
+        fleeFrame = frame;
+    }
+    else if (yTile == 23 && (xTile == 1 || xTile == 26))
+    {
+        blinky.setFlee(true);
+        pinky.setFlee(true);
+        inky.setFlee(true);
+        if (fleeFrame != frame - 1)
+        {
+            events |= GAME_ENERGIZER;
+        }
+        fleeFrame = frame;
+    }
+
+    //energizer expires after 10 seconds
+    if (fleeFrame != 0 && frame == fleeFrame + 600)
+    {
+        blinky.setFlee(false);
+        pinky.setFlee(false);
+        inky.setFlee(false);
+    }
+
+    if (frame % 3 == 0)
+    {
+        //checks if player is dead/dying
+        if (player.getDeathState() || ((player.sharingTile(blinky) && !blinky.getEaten()) || (player.sharingTile(pinky) && !pinky.getEaten()) || (player.sharingTile(inky) && !inky.getEaten()) && !blinky.getFlee()))
+        {
+            if (!player.getDeathState())
+            {
+                events |= GAME_DEATH;
+            }
+            player.kill();
+            //ends game once death animation is over
+            if (player.getDeathState() == 11)
+            {
+                over = true;
+            }
+        }
+        else
+        {
+            //Update player
+            PROFILE_SCOPE(PROFILE_PLAYER);
+            player.update(world);
+
+            //the chomp goes with the mouth, once each time it shuts on the way through pellets
+            if (!player.getMouthOpen() && nearPellet())
+            {
+                events |= GAME_CHOMP;
+            }
+        }
+    }
+
+    //checks if player has eaten ghosts
+    if (!player.getDeathState())
+    {
+        if (blinky.getFlee() && player.sharingTile(blinky))
+        {
+            if (!blinky.getEaten())
+            {
+                events |= GAME_GHOST_EATEN;
+            }
+            blinky.setEaten(true);
+        }
+        if (pinky.getFlee() && player.sharingTile(pinky))
+        {
+            if (!pinky.getEaten())
+            {
+                events |= GAME_GHOST_EATEN;
+            }
+            pinky.setEaten(true);
+        }
+        if (inky.getFlee() && player.sharingTile(inky))
+        {
+            if (!inky.getEaten())
+            {
+                events |= GAME_GHOST_EATEN;
+            }
+            inky.setEaten(true);
+        }
+    }
+
+    //update ghosts
+    if (frame % 4 == 0 && !player.getDeathState())
+    {
+        PROFILE_SCOPE(PROFILE_GHOSTS);
+        if (frame % 1620 == 0)
+        {
+            blinky.setScatter(true);
+            pinky.setScatter(true);
+            inky.setScatter(true);
+        }
+        else if ((frame + 1200) % 1620 == 0)
+        {
+            blinky.setScatter(false);
+            pinky.setScatter(false);
+            inky.setScatter(false);
+        }
+        blinky.decideTurn(world);
+        blinky.update(world);
+        pinky.decideTurn(world);
+        pinky.update(world);
+        inky.decideTurn(world);
+        inky.update(world);
+    }
+    frame++;
+
+    return !over;
+}
+
+void Game::capture(GameState& state) const
+{
+    board.capture(state.crossed);
+    player.capture(state.entities[0]);
+    state.entities[0].death = (uint8_t)player.getDeathState();
+    blinky.capture(state.entities[1]);
+    pinky.capture(state.entities[2]);
+    inky.capture(state.entities[3]);
+    state.frame = frame;
+    state.fleeFrame = fleeFrame;
+    state.crossedTile = (int16_t)crossedTile;
+    state.ghostAI = (uint8_t)ghostAI;
+    memset(state.reserved, 0, sizeof(state.reserved));
+}
+
+void Game::restore(const GameState& state)
+{
+    board.restore(state.crossed);
+    player.restore(state.entities[0]);
+    player.setDeathState(state.entities[0].death);
+    blinky.restore(state.entities[1]);
+    pinky.restore(state.entities[2]);
+    inky.restore(state.entities[3]);
+    frame = state.frame;
+    fleeFrame = state.fleeFrame;
+    crossedTile = state.crossedTile;
+    ghostAI = state.ghostAI;
+    events = 0;
+}
+
+//small deterministic generator for swarm and bot decisions
+static uint32_t nextRandom(uint32_t& state)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+//random bot that changes its mind about once every 16 frames
+static int botAction(uint32_t& seed)
+{
+    uint32_t r = nextRandom(seed);
+    return (r & 15) == 0 ? (int)((r >> 4) & 3) : DEFAULT;
+}
+
+//bot seed for one game of a run, never zero since xorshift would stay there
+static uint32_t gameSeed(uint32_t seed, int game)
+{
+    uint32_t state = seed + (uint32_t)game * 0x9e3779b9u;
+    state ^= state >> 16;
+    state *= 0x85ebca6bu;
+    state ^= state >> 13;
+    state *= 0xc2b2ae35u;
+    state ^= state >> 16;
+    return state ? state : 1;
+}
+
+BatchEnv::BatchEnv(int count, int ai, bool reset)
+    : games(count, Game(ai)), done(count, 0), reward(count, 0)
+{
+    episodes = 0;
+    ghostAI = ai;
+    autoReset = reset;
+}
+
+void BatchEnv::step(const int* actions)
+{
+    for (int i = 0; i < (int)games.size(); i++)
+    {
+        //without autoReset a finished game stays on its last frame
+        if (done[i] && !autoReset)
+        {
+            reward[i] = 0;
+            continue;
+        }
+
+        if (actions[i] != DEFAULT)
+        {
+            games[i].steer(actions[i]);
+        }
+        bool alive = games[i].step();
+        reward[i] = games[i].getCrossedTile() >= 0;
+        done[i] = !alive;
+
+        if (!alive)
+        {
+            episodes++;
+            if (autoReset)
+            {
+                games[i] = Game(ghostAI);
+            }
+        }
+    }
+}
+
+void BatchEnv::reset(int i)
+{
+    games[i] = Game(ghostAI);
+    done[i] = 0;
+    reward[i] = 0;
+}
+
+void BatchEnv::restart(int count, int ai)
+{
+    ghostAI = ai;
+    games.assign(count, Game(ai));
+    done.assign(count, 0);
+    reward.assign(count, 0);
+}
+
+void BatchEnv::restore(int i, const GameState& state)
+{
+    games[i].restore(state);
+    done[i] = 0;
+    reward[i] = 0;
+}
+
+RewindBuffer::RewindBuffer()
+    : segments(SEGMENTS)
+{
+    clear();
+}
+
+void RewindBuffer::clear()
+{
+    newest = 0;
+    count = 0;
+}
+
+void RewindBuffer::push(const Game& game)
+{
+    GameState state;
+    game.capture(state);
+
+    //a full segment, or one that might not fit a worst case delta, starts the next with a keyframe
+    Segment* segment = &segments[newest];
+    const int worstDelta = 4 + sizeof(GameState);
+    if (count == 0 || segment->ticks == SEGMENT_TICKS || segment->used + worstDelta > SEGMENT_BYTES)
+    {
+        newest = (newest + 1) % SEGMENTS;
+        if (count < SEGMENTS)
+        {
+            count++;
+        }
+        segment = &segments[newest];
+        segment->keyframe = state;
+        segment->used = 0;
+        segment->ticks = 1;
+        return;
+    }
+
+    uint64_t words[sizeof(GameState) / 8];
+    uint64_t key[sizeof(GameState) / 8];
+    memcpy(words, &state, sizeof(state));
+    memcpy(key, &segment->keyframe, sizeof(state));
+
+    uint8_t* out = segment->bytes + segment->used;
+    uint32_t mask = 0;
+    int changed = 0;
+    for (int i = 0; i < (int)(sizeof(GameState) / 8); i++)
+    {
+        uint64_t delta = words[i] ^ key[i];
+        if (delta)
+        {
+            mask |= (uint32_t)1 << i;
+            memcpy(out + 4 + changed * 8, &delta, 8);
+            changed++;
+        }
+    }
+    memcpy(out, &mask, 4);
+
+    segment->offsets[segment->ticks] = segment->used;
+    segment->used += 4 + changed * 8;
+    segment->ticks++;
+}
+
+bool RewindBuffer::pop(GameState& state)
+{
+    if (count == 0)
+    {
+        return false;
+    }
+
+    Segment& segment = segments[newest];
+    state = segment.keyframe;
+    if (segment.ticks == 1)
+    {
+        //keyframe was the last tick of this segment, carry on in the one before
+        newest = (newest + SEGMENTS - 1) % SEGMENTS;
+        count--;
+        return true;
+    }
+
+    segment.ticks--;
+    segment.used = segment.offsets[segment.ticks];
+    const uint8_t* in = segment.bytes + segment.used;
+
+    uint64_t words[sizeof(GameState) / 8];
+    memcpy(words, &state, sizeof(state));
+    uint32_t mask;
+    memcpy(&mask, in, 4);
+    in += 4;
+    while (mask)
+    {
+        uint64_t delta;
+        memcpy(&delta, in, 8);
+        in += 8;
+        words[lowestBit64(mask)] ^= delta;
+        mask &= mask - 1;
+    }
+    memcpy(&state, words, sizeof(state));
+    return true;
+}
+
+int RewindBuffer::getTicks() const
+{
+    int ticks = 0;
+    for (int i = 0; i < count; i++)
+    {
+        ticks += segments[(newest + SEGMENTS - i) % SEGMENTS].ticks;
+    }
+    return ticks;
+}
+
+size_t RewindBuffer::getDeltaBytes() const
+{
+    size_t bytes = 0;
+    for (int i = 0; i < count; i++)
+    {
+        bytes += segments[(newest + SEGMENTS - i) % SEGMENTS].used;
+    }
+    return bytes;
+}
+
+bool BatchEnv::running() const
+{
+    for (size_t i = 0; i < done.size(); i++)
+    {
+        if (!done[i] || autoReset)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+BatchRunner::BatchRunner(int count)
+    : workers(count)
+{
+    generation = 0;
+    busy = 0;
+    stopping = false;
+    jobCount = 0;
+    jobSeed = 0;
+    jobAI = ARCADE_AI;
+    jobMaxFrames = 0;
+    jobResults = NULL;
+    for (int i = 0; i < count; i++)
+    {
+        threads.push_back(std::thread(&BatchRunner::work, this, i));
+    }
+}
+
+BatchRunner::~BatchRunner()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (size_t i = 0; i < threads.size(); i++)
+    {
+        threads[i].join();
+    }
+}
+
+void BatchRunner::run(int count, uint32_t seed, int ai, int maxFrames, std::vector<GameResult>& results)
+{
+    results.resize(count);
+
+    //each worker starts with an even, contiguous share of the chunks
+    int chunks = (count + CHUNK - 1) / CHUNK;
+    int threadCount = (int)threads.size();
+    for (int w = 0; w < threadCount; w++)
+    {
+        std::lock_guard<std::mutex> guard(workers[w].lock);
+        workers[w].chunks.clear();
+        workers[w].steals = 0;
+        for (int c = chunks * w / threadCount; c < chunks * (w + 1) / threadCount; c++)
+        {
+            workers[w].chunks.push_back(c);
+        }
+    }
+
+    std::unique_lock<std::mutex> guard(lock);
+    jobCount = count;
+    jobSeed = seed;
+    jobAI = ai;
+    jobMaxFrames = maxFrames;
+    jobResults = results.data();
+    busy = threadCount;
+    generation++;
+    wake.notify_all();
+    while (busy != 0)
+    {
+        finished.wait(guard);
+    }
+}
+
+long BatchRunner::getSteals() const
+{
+    long steals = 0;
+    for (size_t w = 0; w < workers.size(); w++)
+    {
+        steals += workers[w].steals;
+    }
+    return steals;
+}
+
+void BatchRunner::work(int id)
+{
+    int seen = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            while (!stopping && generation == seen)
+            {
+                wake.wait(guard);
+            }
+            if (stopping)
+            {
+                return;
+            }
+            seen = generation;
+        }
+
+        int chunk;
+        while (takeChunk(id, chunk))
+        {
+            playChunk(workers[id], chunk);
+        }
+
+        std::lock_guard<std::mutex> guard(lock);
+        if (--busy == 0)
+        {
+            finished.notify_all();
+        }
+    }
+}
+
+bool BatchRunner::takeChunk(int id, int& chunk)
+{
+    {
+        std::lock_guard<std::mutex> guard(workers[id].lock);
+        if (!workers[id].chunks.empty())
+        {
+            chunk = workers[id].chunks.front();
+            workers[id].chunks.pop_front();
+            return true;
+        }
+    }
+
+    //nothing left of our own, so take the last chunk of the next worker that has any
+    for (size_t i = 1; i < workers.size(); i++)
+    {
+        Worker& victim = workers[(id + i) % workers.size()];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (!victim.chunks.empty())
+        {
+            chunk = victim.chunks.back();
+            victim.chunks.pop_back();
+            workers[id].steals++;
+            return true;
+        }
+    }
+    return false;
+}
+
+void BatchRunner::playChunk(Worker& worker, int chunk)
+{
+    int begin = chunk * CHUNK;
+    int count = std::min(CHUNK, jobCount - begin);
+
+    worker.arena.restart(count, jobAI);
+    worker.actions.resize(count);
+    worker.seeds.resize(count);
+    for (int i = 0; i < count; i++)
+    {
+        worker.seeds[i] = gameSeed(jobSeed, begin + i);
+    }
+
+    for (int frame = 0; frame < jobMaxFrames && worker.arena.running(); frame++)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            worker.actions[i] = botAction(worker.seeds[i]);
+        }
+        worker.arena.step(worker.actions.data());
+    }
+
+    static const int pellets = Board().pelletsLeft();
+    for (int i = 0; i < count; i++)
+    {
+        const Game& game = worker.arena.getGame(i);
+        GameResult& result = jobResults[begin + i];
+        result.frames = game.getFrame();
+        result.pellets = pellets - game.getBoard().pelletsLeft();
+        result.died = worker.arena.getDone()[i] != 0;
+    }
+}
+
+Profiler::Profiler()
+{
+    enabled = false;
+    tracing = false;
+    logging = false;
+    origin = 0;
+    memset(current, 0, sizeof(current));
+    touched = false;
+    memset(history, 0, sizeof(history));
+    frames = 0;
+}
+
+void Profiler::setEnabled(bool b)
+{
+    enabled = b && PACMAN_PROFILE;
+    owner = std::this_thread::get_id();
+    if (enabled && origin == 0)
+    {
+        origin = SDL_GetPerformanceCounter();
+    }
+}
+
+void Profiler::record(int phase, Uint64 start, Uint64 end)
+{
+    current[phase] += end - start;
+    touched = true;
+    if (tracing && events.size() < MAX_EVENTS)
+    {
+        Event event = { start, end, phase };
+        events.push_back(event);
+    }
+}
+
+void Profiler::endFrame()
+{
+    if (!touched)
+    {
+        return;
+    }
+
+    float toMilliseconds = 1000.0f / SDL_GetPerformanceFrequency();
+    float* totals = history[frames % WINDOW];
+    for (int p = 0; p < PROFILE_PHASES; p++)
+    {
+        totals[p] = current[p] * toMilliseconds;
+        current[p] = 0;
+    }
+    if (logging && log.size() < (size_t)MAX_FRAMES * PROFILE_PHASES)
+    {
+        log.insert(log.end(), totals, totals + PROFILE_PHASES);
+    }
+    touched = false;
+    frames++;
+}
+
+void Profiler::getStats(int phase, float& min, float& avg, float& p99) const
+{
+    int count = std::min(frames, WINDOW);
+    if (count == 0)
+    {
+        min = avg = p99 = 0;
+        return;
+    }
+
+    float sorted[WINDOW];
+    float sum = 0;
+    for (int i = 0; i < count; i++)
+    {
+        sorted[i] = history[i][phase];
+        sum += sorted[i];
+    }
+    std::sort(sorted, sorted + count);
+    min = sorted[0];
+    avg = sum / count;
+    p99 = sorted[(count - 1) * 99 / 100];
+}
+
+void Profiler::printStats() const
+{
+    printf("%-13s %8s %8s %8s  (ms over the last %d frames)\n", "phase", "min", "avg", "p99", std::min(frames, WINDOW));
+    for (int p = 0; p < PROFILE_PHASES; p++)
+    {
+        float min, avg, p99;
+        getStats(p, min, avg, p99);
+        printf("%-13s %8.3f %8.3f %8.3f\n", getName(p), min, avg, p99);
+    }
+}
+
+bool Profiler::writeTrace( std::string path ) const
+{
+    FILE* file = fopen( path.c_str(), "w" );
+    if( file == NULL )
+    {
+        printf( "Unable to write trace %s!\n", path.c_str() );
+        return false;
+    }
+
+    //complete events in microseconds, which chrome://tracing and Perfetto both load
+    double toMicroseconds = 1e6 / SDL_GetPerformanceFrequency();
+    fprintf( file, "{\"traceEvents\":[\n" );
+    for( size_t i = 0; i < events.size(); i++ )
+    {
+        fprintf( file, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f}%s\n", getName( events[ i ].phase ),
+                 ( events[ i ].start - origin ) * toMicroseconds, ( events[ i ].end - events[ i ].start ) * toMicroseconds,
+                 i + 1 < events.size() ? "," : "" );
+    }
+    fprintf( file, "],\"displayTimeUnit\":\"ms\"}\n" );
+    fclose( file );
+    return true;
+}
+
+bool Profiler::writeCSV( std::string path ) const
+{
+    FILE* file = fopen( path.c_str(), "w" );
+    if( file == NULL )
+    {
+        printf( "Unable to write profile %s!\n", path.c_str() );
+        return false;
+    }
+
+    fprintf( file, "frame" );
+    for( int p = 0; p < PROFILE_PHASES; p++ )
+    {
+        fprintf( file, ",%s_ms", getName( p ) );
+    }
+    fprintf( file, "\n" );
+    for( size_t row = 0; row * PROFILE_PHASES < log.size(); row++ )
+    {
+        fprintf( file, "%d", (int)row );
+        for( int p = 0; p < PROFILE_PHASES; p++ )
+        {
+            fprintf( file, ",%.4f", log[ row * PROFILE_PHASES + p ] );
+        }
+        fprintf( file, "\n" );
+    }
+    fclose( file );
+    return true;
+}
+
+const char* Profiler::getName(int phase)
+{
+    static const char* names[PROFILE_PHASES] = { "events", "simulation", "board_update", "player", "ghosts", "board_render",
+                                                 "sprites", "present", "frame" };
+    return names[phase];
+}
+
+FrameHistogram::FrameHistogram()
+{
+    clear();
+}
+
+void FrameHistogram::clear()
+{
+    memset(counts, 0, sizeof(counts));
+    count = 0;
+    sum = 0;
+    max = 0;
+}
+
+int FrameHistogram::bucketOf(Uint64 value)
+{
+    value = std::min(value, ((Uint64)1 << MAX_BITS) - 1);
+    if (value < SUB_COUNT)
+    {
+        return (int)value;
+    }
+
+    //shift so the top SUB_BITS bits remain, then each shift gets its own half row of buckets
+    int shift = highestBit64(value) - (SUB_BITS - 1);
+    return shift * (SUB_COUNT / 2) + (int)(value >> shift);
+}
+
+Uint64 FrameHistogram::highestIn(int bucket)
+{
+    if (bucket < SUB_COUNT)
+    {
+        return bucket;
+    }
+    int shift = bucket / (SUB_COUNT / 2) - 1;
+    Uint64 sub = bucket - shift * (SUB_COUNT / 2);
+    return ((sub + 1) << shift) - 1;
+}
+
+void FrameHistogram::record(Uint64 microseconds)
+{
+    counts[bucketOf(microseconds)]++;
+    count++;
+    sum += microseconds;
+    max = std::max(max, microseconds);
+}
+
+Uint64 FrameHistogram::percentile(double p) const
+{
+    long rank = (long)(p / 100.0 * count + 0.5);
+    rank = std::max(1L, std::min(rank, count));
+    long seen = 0;
+    for (int b = 0; b < BUCKETS; b++)
+    {
+        seen += counts[b];
+        if (seen >= rank)
+        {
+            return std::min(highestIn(b), max);
+        }
+    }
+    return max;
+}
+
+FrameMonitor::FrameMonitor()
+{
+    hitchCount = 0;
+    memset(hitchesByPhase, 0, sizeof(hitchesByPhase));
+    memset(eventFrames, 0, sizeof(eventFrames));
+    memset(eventHitches, 0, sizeof(eventHitches));
+    lastEvents = 0;
+}
+
+void FrameMonitor::recordFrame(Uint64 microseconds, Uint64 deadline, int gameFrame, int events, const Profiler& profiler)
+{
+    histogram.record(microseconds);
+
+    //sleeping to the refresh wobbles by a millisecond or so, half a period over means the refresh was missed
+    bool hitch = microseconds * 2 > deadline * 3;
+    int nearby = events | lastEvents;
+    for (int e = 0; e < GAME_EVENT_KINDS; e++)
+    {
+        if (events & (1 << e))
+        {
+            eventFrames[e]++;
+        }
+        if (hitch && (nearby & (1 << e)))
+        {
+            eventHitches[e]++;
+        }
+    }
+    lastEvents = events;
+
+    if (hitch)
+    {
+        int phase = profiler.isEnabled() ? slowestPhase(profiler) : PROFILE_FRAME;
+        hitchCount++;
+        hitchesByPhase[phase]++;
+        if ((int)hitches.size() < MAX_HITCHES)
+        {
+            Hitch h = { gameFrame, microseconds, phase, nearby };
+            hitches.push_back(h);
+        }
+    }
+}
+
+int FrameMonitor::slowestPhase(const Profiler& profiler)
+{
+    //simulation counts without the parts timed inside it, and whatever no phase covers is the frame's own
+    float own[PROFILE_PHASES];
+    for (int p = 0; p < PROFILE_PHASES; p++)
+    {
+        own[p] = profiler.getLast(p);
+    }
+    own[PROFILE_SIMULATION] -= own[PROFILE_BOARD_UPDATE] + own[PROFILE_PLAYER] + own[PROFILE_GHOSTS];
+    own[PROFILE_FRAME] -= profiler.getLast(PROFILE_EVENTS) + profiler.getLast(PROFILE_SIMULATION) + profiler.getLast(PROFILE_BOARD_RENDER) +
+                          profiler.getLast(PROFILE_SPRITES) + profiler.getLast(PROFILE_PRESENT);
+
+    int slowest = PROFILE_FRAME;
+    for (int p = 0; p < PROFILE_PHASES; p++)
+    {
+        if (own[p] > own[slowest])
+        {
+            slowest = p;
+        }
+    }
+    return slowest;
+}
+
+void FrameMonitor::printSummary() const
+{
+    static const char* eventNames[GAME_EVENT_KINDS] = { "energizer", "ghost eaten", "death" };
+
+    printf("frames %ld, mean %.2f ms, p50 %.2f, p90 %.2f, p99 %.2f, p99.9 %.2f, max %.2f ms\n", histogram.getCount(),
+           histogram.getMean() / 1000, histogram.percentile(50) / 1000.0, histogram.percentile(90) / 1000.0,
+           histogram.percentile(99) / 1000.0, histogram.percentile(99.9) / 1000.0, histogram.getMax() / 1000.0);
+    printf("hitches %ld", hitchCount);
+    for (int p = 0; p < PROFILE_PHASES; p++)
+    {
+        if (hitchesByPhase[p])
+        {
+            //time no phase accounts for, mostly oversleeping or the OS
+            printf(", %s %ld", p == PROFILE_FRAME ? "untimed" : Profiler::getName(p), hitchesByPhase[p]);
+        }
+    }
+    printf("\n");
+    for (int e = 0; e < GAME_EVENT_KINDS; e++)
+    {
+        printf("%-12s %ld frames, %ld with a hitch\n", eventNames[e], eventFrames[e], eventHitches[e]);
+    }
+    for (size_t i = 0; i < hitches.size(); i++)
+    {
+        printf("hitch at game frame %d: %.2f ms, %s", hitches[i].gameFrame, hitches[i].microseconds / 1000.0,
+               hitches[i].phase == PROFILE_FRAME ? "untimed" : Profiler::getName(hitches[i].phase));
+        for (int e = 0; e < GAME_EVENT_KINDS; e++)
+        {
+            if (hitches[i].events & (1 << e))
+            {
+                printf(", %s", eventNames[e]);
+            }
+        }
+        printf("\n");
+    }
+}
+
+LatencyTracker::LatencyTracker()
+{
+    memset(&pending, 0, sizeof(pending));
+    waiting = false;
+    ticks = 0;
+    superseded = 0;
+    timedOut = 0;
+    frequency = SDL_GetPerformanceFrequency();
+    random = 0x2545f491u;
+    lastInjected = -TICKS_PER_SECOND;
+}
+
+void LatencyTracker::press(int direction, Uint64 time, const Game& game)
+{
+    //already going that way, or dying, nothing on screen will change
+    const Player& player = game.getPlayer();
+    if (direction == player.getOrientation() || player.getDeathState())
+    {
+        return;
+    }
+
+    //the new turn replaces the one still waiting, as it does in the game
+    if (waiting)
+    {
+        superseded++;
+    }
+    pending.direction = direction;
+    pending.tick = game.getFrame();
+    pending.time = time;
+    waiting = true;
+}
+
+void LatencyTracker::update(const Game& game, Uint64 time)
+{
+    if (!waiting)
+    {
+        return;
+    }
+
+    //rewinding back past the press loses it too
+    int frame = game.getFrame();
+    if (frame > pending.tick + TIMEOUT_TICKS || frame < pending.tick)
+    {
+        timedOut++;
+        waiting = false;
+    }
+    else if (frame > pending.tick && game.getPlayer().getOrientation() == pending.direction)
+    {
+        pending.turnTime = time;
+        toTurn.record((time - pending.time) * 1000000 / frequency);
+        ticks += frame - pending.tick;
+        turned.push_back(pending);
+        waiting = false;
+    }
+}
+
+void LatencyTracker::presented(Uint64 time)
+{
+    for (size_t i = 0; i < turned.size(); i++)
+    {
+        toPresent.record((time - turned[i].time) * 1000000 / frequency);
+    }
+    turned.clear();
+}
+
+bool LatencyTracker::inject(const Game& game, int samples)
+{
+    if (getSamples() >= samples)
+    {
+        return false;
+    }
+
+    //one press in flight at a time, a quarter second apart
+    const Player& player = game.getPlayer();
+    if (waiting || !turned.empty() || game.getFrame() < lastInjected + TICKS_PER_SECOND / 4 || player.getDeathState())
+    {
+        return true;
+    }
+
+    //the next tile centre the player reaches, or the one it is stuck on against a wall
+    int x = player.getXLoc();
+    int y = player.getYLoc();
+    int xOffset = ((x - 15) % 8 + 8) % 8;
+    int yOffset = ((y - 13) % 8 + 8) % 8;
+    int orientation = player.getOrientation();
+    bool centred = xOffset == 0 && yOffset == 0;
+    if (orientation != DEFAULT && (!centred || game.getBoard().getExits(((y - 4) / 8) * BOARD_COLUMNS + (x - 4) / 8) & (1 << orientation)))
+    {
+        switch (orientation)
+        {
+            case RIGHT:
+            x += 8 - xOffset;
+            break;
+            case LEFT:
+            x -= xOffset ? xOffset : 8;
+            break;
+            case UP:
+            y -= yOffset ? yOffset : 8;
+            break;
+            default:
+            y += 8 - yOffset;
+            break;
+        }
+    }
+    int xTile = (x - 4) / 8;
+    int yTile = (y - 4) / 8;
+    if (x < 4 || xTile >= BOARD_COLUMNS || y < 4 || yTile >= BOARD_ROWS)
+    {
+        return true;
+    }
+
+    //a way out of that tile other than the way the player is already going
+    int exits = game.getBoard().getExits(yTile * BOARD_COLUMNS + xTile) & ~(1 << orientation);
+    if (exits == 0)
+    {
+        return true;
+    }
+    int pick = (int)(nextRandom(random) % (uint32_t)popcount64((uint64_t)exits));
+    while (pick--)
+    {
+        exits &= exits - 1;
+    }
+
+    //through SDL's queue like a real key, so the time it waits there is counted too
+    static const SDL_Keycode keys[4] = { SDLK_RIGHT, SDLK_LEFT, SDLK_UP, SDLK_DOWN };
+    SDL_Event e;
+    memset(&e, 0, sizeof(e));
+    e.type = SDL_KEYDOWN;
+    e.key.timestamp = SDL_GetTicks();
+    e.key.keysym.sym = keys[lowestBit64((uint64_t)exits)];
+    SDL_PushEvent(&e);
+    lastInjected = game.getFrame();
+    return true;
+}
+
+void LatencyTracker::printSummary() const
+{
+    printf("input latency over %ld turns, %.2f ticks average wait for a tile centre\n", toPresent.getCount(),
+           toTurn.getCount() ? (double)ticks / toTurn.getCount() : 0.0);
+    printf("press to turn     mean %.2f ms, p50 %.2f, p90 %.2f, p99 %.2f, max %.2f ms\n", toTurn.getMean() / 1000,
+           toTurn.percentile(50) / 1000.0, toTurn.percentile(90) / 1000.0, toTurn.percentile(99) / 1000.0, toTurn.getMax() / 1000.0);
+    printf("press to present  mean %.2f ms, p50 %.2f, p90 %.2f, p99 %.2f, max %.2f ms\n", toPresent.getMean() / 1000,
+           toPresent.percentile(50) / 1000.0, toPresent.percentile(90) / 1000.0, toPresent.percentile(99) / 1000.0,
+           toPresent.getMax() / 1000.0);
+    printf("%ld presses replaced by a later one, %ld never turned the player\n", superseded, timedOut);
+}
+
+InputScript::InputScript()
+{
+    next = 0;
+}
+
+bool InputScript::loadFromFile( std::string path )
+{
+    frames.clear();
+    turns.clear();
+    next = 0;
+
+    FILE* file = fopen( path.c_str(), "r" );
+    if( file == NULL )
+    {
+        printf( "Unable to open input script %s!\n", path.c_str() );
+        return false;
+    }
+
+    bool success = true;
+    char line[128];
+    int lineNumber = 0;
+    while( fgets( line, sizeof( line ), file ) != NULL )
+    {
+        lineNumber++;
+
+        //skip blank lines and comments
+        char* start = line + strspn( line, " \t\r\n" );
+        if( *start == '\0' || *start == '#' )
+        {
+            continue;
+        }
+
+        int frame;
+        char name[16];
+        int turn = DEFAULT;
+        if( sscanf( start, "%d %15s", &frame, name ) == 2 )
+        {
+            if( strcmp( name, "RIGHT" ) == 0 ) turn = RIGHT;
+            else if( strcmp( name, "LEFT" ) == 0 ) turn = LEFT;
+            else if( strcmp( name, "UP" ) == 0 ) turn = UP;
+            else if( strcmp( name, "DOWN" ) == 0 ) turn = DOWN;
+        }
+        if( turn == DEFAULT || frame < 0 || ( !frames.empty() && frame < frames.back() ) )
+        {
+            printf( "%s:%d: expected \"<frame> <RIGHT|LEFT|UP|DOWN>\" in frame order\n", path.c_str(), lineNumber );
+            success = false;
+            break;
+        }
+        frames.push_back( frame );
+        turns.push_back( turn );
+    }
+
+    fclose( file );
+    return success;
+}
+
+int InputScript::turnAt(int frame)
+{
+    int turn = DEFAULT;
+    while (next < frames.size() && frames[next] <= frame)
+    {
+        turn = turns[next];
+        next++;
+    }
+    return turn;
+}
+
+void InputScript::rewind()
+{
+    next = 0;
+}
+
+//a replay record, turn or end marker
+static uint32_t replayRecord(int tick, int direction)
+{
+    return ((uint32_t)tick << 3) | (uint32_t)direction;
+}
+
+ReplayWriter::ReplayWriter()
+{
+    file = NULL;
+    failed = false;
+    stopping = false;
+}
+
+ReplayWriter::~ReplayWriter()
+{
+    if( file != NULL )
+    {
+        close( -1 );
+    }
+}
+
+bool ReplayWriter::open( std::string p, int ai, uint32_t seed )
+{
+    path = p;
+    file = fopen( path.c_str(), "wb" );
+    if( file == NULL )
+    {
+        printf( "Unable to create replay %s!\n", path.c_str() );
+        return false;
+    }
+
+    ReplayHeader header;
+    memset( &header, 0, sizeof( header ) );
+    memcpy( header.magic, "PMRP", 4 );
+    header.version = 1;
+    header.ghostAI = (uint8_t)ai;
+    header.ticksPerSecond = TICKS_PER_SECOND;
+    header.seed = seed;
+    header.mazeHash = mazeHash( MAZE );
+    if( fwrite( &header, sizeof( header ), 1, file ) != 1 || fflush( file ) != 0 )
+    {
+        printf( "Unable to write replay %s!\n", path.c_str() );
+        fclose( file );
+        file = NULL;
+        return false;
+    }
+
+    failed = false;
+    stopping = false;
+    thread = std::thread( &ReplayWriter::work, this );
+    return true;
+}
+
+void ReplayWriter::append( int tick, int direction )
+{
+    std::lock_guard<std::mutex> guard( lock );
+    pending.push_back( replayRecord( tick, direction ) );
+    wake.notify_one();
+}
+
+bool ReplayWriter::close( int tick )
+{
+    {
+        std::lock_guard<std::mutex> guard( lock );
+        if( tick >= 0 )
+        {
+            pending.push_back( replayRecord( tick, DEFAULT ) );
+        }
+        stopping = true;
+    }
+    wake.notify_one();
+    thread.join();
+
+    if( fclose( file ) != 0 && !failed )
+    {
+        printf( "Unable to write replay %s!\n", path.c_str() );
+        failed = true;
+    }
+    file = NULL;
+    return !failed;
+}
+
+void ReplayWriter::work()
+{
+    std::vector<uint32_t> batch;
+    while( true )
+    {
+        bool last;
+        {
+            std::unique_lock<std::mutex> guard( lock );
+            while( pending.empty() && !stopping )
+            {
+                wake.wait( guard );
+            }
+            batch.swap( pending );
+            last = stopping;
+        }
+
+        //flushed as it goes, so a crashed session keeps everything up to its last turn
+        //once a write has failed the rest are dropped, close reports it
+        if( !batch.empty() && !failed )
+        {
+            if( fwrite( batch.data(), 4, batch.size(), file ) != batch.size() || fflush( file ) != 0 )
+            {
+                printf( "Unable to write replay %s, the recording stops at the last turn written!\n", path.c_str() );
+                failed = true;
+            }
+        }
+        batch.clear();
+        if( last )
+        {
+            return;
+        }
+    }
+}
+
+ReplayFile::ReplayFile()
+{
+    records = 0;
+    next = 0;
+}
+
+ReplayFile::~ReplayFile()
+{
+    close();
+}
+
+MappedFile::MappedFile()
+{
+    data = NULL;
+    size = 0;
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open( std::string path )
+{
+    close();
+
+#ifdef PACMAN_MMAP
+    int descriptor = ::open( path.c_str(), O_RDONLY );
+    struct stat info;
+    if( descriptor < 0 || fstat( descriptor, &info ) != 0 )
+    {
+        if( descriptor >= 0 )
+        {
+            ::close( descriptor );
+        }
+        return false;
+    }
+    size = (size_t)info.st_size;
+    if( size > 0 )
+    {
+        void* mapping = mmap( NULL, size, PROT_READ, MAP_PRIVATE, descriptor, 0 );
+        data = mapping == MAP_FAILED ? NULL : (const uint8_t*)mapping;
+    }
+    ::close( descriptor );
+#else
+    FILE* file = fopen( path.c_str(), "rb" );
+    if( file == NULL )
+    {
+        return false;
+    }
+    fseek( file, 0, SEEK_END );
+    buffer.resize( (size_t)ftell( file ) );
+    fseek( file, 0, SEEK_SET );
+    size = fread( buffer.data(), 1, buffer.size(), file );
+    fclose( file );
+    data = size > 0 ? buffer.data() : NULL;
+#endif
+
+    if( data == NULL )
+    {
+        size = 0;
+        return false;
+    }
+    return true;
+}
+
+void MappedFile::close()
+{
+#ifdef PACMAN_MMAP
+    if( data != NULL )
+    {
+        munmap( (void*)data, size );
+    }
+#endif
+    buffer.clear();
+    data = NULL;
+    size = 0;
+}
+
+bool ReplayFile::open( std::string path )
+{
+    close();
+
+    if( !file.open( path ) )
+    {
+        printf( "Unable to open replay %s!\n", path.c_str() );
+        return false;
+    }
+    if( file.getSize() < sizeof( ReplayHeader ) || memcmp( getHeader().magic, "PMRP", 4 ) != 0 )
+    {
+        printf( "%s is not a replay!\n", path.c_str() );
+        close();
+        return false;
+    }
+    if( getHeader().version != 1 || getHeader().mazeHash != mazeHash( MAZE ) )
+    {
+        printf( "%s was recorded by a different version or on a different maze!\n", path.c_str() );
+        close();
+        return false;
+    }
+
+    //a torn last record is dropped
+    records = (int)( ( file.getSize() - sizeof( ReplayHeader ) ) / 4 );
+    next = 0;
+    return true;
+}
+
+void ReplayFile::close()
+{
+    file.close();
+    records = 0;
+    next = 0;
+}
+
+uint64_t ReplayFile::getHash() const
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    size_t size = sizeof( ReplayHeader ) + (size_t)records * 4;
+    for( size_t i = 0; i < size; i++ )
+    {
+        hash = ( hash ^ file.getData()[ i ] ) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+int ReplayFile::getEndTick() const
+{
+    if( records > 0 && getDirection( records - 1 ) == DEFAULT )
+    {
+        return getTick( records - 1 );
+    }
+    return -1;
+}
+
+int ReplayFile::seek(int tick) const
+{
+    //records are in tick order, so binary search
+    int low = 0;
+    int high = records;
+    while (low < high)
+    {
+        int middle = (low + high) / 2;
+        if (getTick(middle) < tick)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+int ReplayFile::turnAt(int tick)
+{
+    int turn = DEFAULT;
+    while (next < records && getTick(next) <= tick)
+    {
+        if (getDirection(next) != DEFAULT)
+        {
+            turn = getDirection(next);
+        }
+        next++;
+    }
+    return turn;
+}
+
+void ReplayFile::moveTo(int tick)
+{
+    next = seek(tick);
+}
+
+void ReplayFile::rewind()
+{
+    next = 0;
+}
+
+KeyframeIndex::KeyframeIndex()
+{
+    interval = INTERVAL;
+    count = 0;
+}
+
+bool KeyframeIndex::build( ReplayFile& replay, std::string path, int every )
+{
+    close();
+
+    //same playback as runReplay, with a snapshot every interval ticks
+    //a recording cut off before its end marker is indexed up to its last turn, seeks past that play on from there
+    std::vector<GameState> keyframes;
+    int endTick = replay.getEndTick();
+    int lastTick = replay.getRecordCount() > 0 ? replay.getTick( replay.getRecordCount() - 1 ) : 0;
+    int maxFrames = std::max( endTick >= 0 ? endTick : lastTick + 1, 1 );
+    Game game( replay.getHeader().ghostAI );
+    replay.rewind();
+    bool running = true;
+    while( running && game.getFrame() < maxFrames )
+    {
+        if( game.getFrame() % every == 0 )
+        {
+            keyframes.push_back( GameState() );
+            game.capture( keyframes.back() );
+        }
+        int turn = replay.turnAt( game.getFrame() );
+        if( turn != DEFAULT )
+        {
+            game.steer( turn );
+        }
+        running = game.step();
+    }
+    replay.rewind();
+
+    FILE* out = fopen( path.c_str(), "wb" );
+    if( out == NULL )
+    {
+        printf( "Unable to create keyframe index %s!\n", path.c_str() );
+        return false;
+    }
+    KeyframeHeader header;
+    memset( &header, 0, sizeof( header ) );
+    memcpy( header.magic, "PMKI", 4 );
+    header.version = 1;
+    header.interval = (uint32_t)every;
+    header.count = (uint32_t)keyframes.size();
+    header.replayHash = replay.getHash();
+    bool success = fwrite( &header, sizeof( header ), 1, out ) == 1 &&
+                   fwrite( keyframes.data(), sizeof( GameState ), keyframes.size(), out ) == keyframes.size();
+    fclose( out );
+    if( !success )
+    {
+        printf( "Unable to write keyframe index %s!\n", path.c_str() );
+    }
+    return success;
+}
+
+bool KeyframeIndex::open( std::string path, const ReplayFile& replay )
+{
+    close();
+    if( !file.open( path ) )
+    {
+        return false;
+    }
+
+    KeyframeHeader header;
+    if( file.getSize() >= sizeof( header ) )
+    {
+        memcpy( &header, file.getData(), sizeof( header ) );
+    }
+    if( file.getSize() < sizeof( header ) || memcmp( header.magic, "PMKI", 4 ) != 0 || header.version != 1 || header.interval == 0 ||
+        header.count == 0 || file.getSize() != sizeof( header ) + (size_t)header.count * sizeof( GameState ) ||
+        header.replayHash != replay.getHash() )
+    {
+        close();
+        return false;
+    }
+    interval = (int)header.interval;
+    count = (int)header.count;
+    return true;
+}
+
+bool KeyframeIndex::openOrBuild( std::string path, ReplayFile& replay )
+{
+    if( open( path, replay ) )
+    {
+        return true;
+    }
+    return build( replay, path ) && open( path, replay );
+}
+
+void KeyframeIndex::close()
+{
+    file.close();
+    interval = INTERVAL;
+    count = 0;
+}
+
+bool KeyframeIndex::seek( ReplayFile& replay, Game& game, int tick ) const
+{
+    if( count == 0 || tick < 0 )
+    {
+        return false;
+    }
+
+    int keyframe = std::min( tick / interval, count - 1 );
+    GameState state;
+    memcpy( &state, file.getData() + sizeof( KeyframeHeader ) + (size_t)keyframe * sizeof( GameState ), sizeof( state ) );
+    game.restore( state );
+    replay.moveTo( game.getFrame() );
+
+    //the rest of the way is plain playback, which stops where the recording did
+    int stop = replay.getEndTick() >= 0 ? std::min( tick, replay.getEndTick() ) : tick;
+    bool running = true;
+    while( running && game.getFrame() < stop )
+    {
+        int turn = replay.turnAt( game.getFrame() );
+        if( turn != DEFAULT )
+        {
+            game.steer( turn );
+        }
+        running = game.step();
+    }
+    return game.getFrame() == tick;
+}
+
+SimulationThread::SimulationThread( BatchEnv& e, ReplayFile* r, ReplayWriter& w, RewindBuffer* b, int end )
+    : env( e ), recorder( w ), action( DEFAULT ), rewinding( false ), stopping( false ), finished( false ), events( 0 )
+{
+    replay = r;
+    rewind = b;
+    endTick = end;
+}
+
+SimulationThread::~SimulationThread()
+{
+    stop();
+}
+
+void SimulationThread::start()
+{
+    stopping = false;
+    finished = false;
+    thread = std::thread( &SimulationThread::run, this );
+}
+
+void SimulationThread::stop()
+{
+    if( thread.joinable() )
+    {
+        stopping = true;
+        thread.join();
+    }
+}
+
+void SimulationThread::setAction( int a )
+{
+    action.store( a, std::memory_order_relaxed );
+}
+
+void SimulationThread::setRewinding( bool b )
+{
+    rewinding.store( b, std::memory_order_relaxed );
+}
+
+void SimulationThread::run()
+{
+    const Game& game = env.getGame( 0 );
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+    Uint64 tickLength = frequency / TICKS_PER_SECOND;
+    Uint64 next = SDL_GetPerformanceCounter() + tickLength;
+    while( !stopping.load( std::memory_order_relaxed ) )
+    {
+        Uint64 now = SDL_GetPerformanceCounter();
+        if( now < next )
+        {
+            std::this_thread::sleep_for( std::chrono::microseconds( ( next - now ) * 1000000 / frequency ) );
+            continue;
+        }
+
+        //don't try to catch up after long stalls
+        if( now - next > tickLength * TICKS_PER_SECOND / 4 )
+        {
+            next = now;
+        }
+        next += tickLength;
+
+        //a turn pressed while rewinding waits for the rewind to end
+        bool back = rewinding.load( std::memory_order_relaxed );
+        int turn = back ? DEFAULT : action.exchange( DEFAULT, std::memory_order_relaxed );
+
+        //previous stays on the current positions when nothing moves
+        FrameSnapshot& snapshot = snapshots.getBack();
+        capturePositions( game, snapshot.previous );
+        int tickEvents = 0;
+        bool running = playTick( env, turn, back, replay, recorder, rewind, endTick, snapshot.previous, tickEvents );
+        game.capture( snapshot.state );
+        snapshot.time = SDL_GetPerformanceCounter();
+        snapshots.publish();
+        events.fetch_or( tickEvents, std::memory_order_relaxed );
+        if( !running )
+        {
+            finished.store( true, std::memory_order_release );
+            return;
+        }
+    }
+}
+
+bool init()
+{
+	//Initialization flag
+	bool success = true;
+
+	//Initialize SDL
+	if( SDL_Init( SDL_INIT_VIDEO ) < 0 )
+	{
+		printf( "SDL could not initialize! SDL Error: %s\n", SDL_GetError() );
+		success = false;
+	}
+	else
+	{
+		//Set texture filtering to linear
+		if( !SDL_SetHint( SDL_HINT_RENDER_SCALE_QUALITY, "1" ) )
+		{
+			printf( "Warning: Linear texture filtering not enabled!" );
+		}
+
+		//Create window
+		gWindow = SDL_CreateWindow( "Pac-Man", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_SHOWN );
+		if( gWindow == NULL )
+		{
+			printf( "Window could not be created! SDL Error: %s\n", SDL_GetError() );
+			success = false;
+		}
+		else
+		{
+			//Create renderer for window
+			gRenderer = SDL_CreateRenderer( gWindow, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC );
+			if( gRenderer == NULL )
+			{
+				printf( "Renderer could not be created! SDL Error: %s\n", SDL_GetError() );
+				success = false;
+			}
+			else
+			{
+				//Initialize renderer color
+				SDL_SetRenderDrawColor( gRenderer, 0, 0, 0, 0 );
+
+				//Initialize PNG loading
+				int imgFlags = IMG_INIT_PNG;
+				if( !( IMG_Init( imgFlags ) & imgFlags ) )
+				{
+					printf( "SDL_image could not initialize! SDL_mage Error: %s\n", IMG_GetError() );
+					success = false;
+				}
+			}
+		}
+	}
+
+	return success;
+}
+
+int abs(int n)
+{
+    return n > 0 ? n : -n;
+}
+
+bool loadMedia()
+{
+	//Loading success flag
+	bool success = true;
+
+	//Load sprite sheet texture
+	if( !gSpriteSheetTexture.loadFromFile( "pacman.png" ) )
+	{
+		printf( "Failed to load sprite sheet texture!\n" );
+		success = false;
+	}
+	else
+	{
+		//Set board sprite
+		gBoard.x =   0;
+		gBoard.y =   0;
+		gBoard.w = 224;
+		gBoard.h = 248;
+
+		//Set player sprites
+		for (int i = 0; i < 4; i++)
+        {
+            for (int j = 0; j < 2; j++)
+            {
+                int index = (2 * i) + j;
+                gPlayer[index].x = 456 + (16 * j);
+                gPlayer[index].y = (16 * i);
+                gPlayer[index].w = 16;
+                gPlayer[index].h = 16;
+            }
+		}
+
+		//Split up board into tiles
+		for (int i = 0; i < 31; i++)
+        {
+            for (int j = 0; j < 28; j++)
+            {
+                gBoardPieces[i][j].y = i * 8;
+                gBoardPieces[i][j].x = j * 8;
+                gBoardPieces[i][j].w = 8;
+                gBoardPieces[i][j].h = 8;
+            }
+        }
+
+        //Do the same for alternate board
+        for (int i = 0; i < 31; i++)
+        {
+            for (int j = 0; j < 28; j++)
+            {
+                gBoardPiecesAlt[i][j].y = i * 8;
+                gBoardPiecesAlt[i][j].x = (j * 8) + 228;
+                gBoardPiecesAlt[i][j].w = 8;
+                gBoardPiecesAlt[i][j].h = 8;
+            }
+        }
+
+        //Set sprites for ghosts
+        for (int i = 0; i < 8; i++)
+        {
+            gBlinky[i].y = 64;
+            gBlinky[i].x = 456 + (16 * i);
+            gBlinky[i].w = 16;
+            gBlinky[i].h = 16;
+
+            gPinky[i].y = 80;
+            gPinky[i].x = 456 + (16 * i);
+            gPinky[i].w = 16;
+            gPinky[i].h = 16;
+
+            gInky[i].y = 96;
+            gInky[i].x = 456 + (16 * i);
+            gInky[i].w = 16;
+            gInky[i].h = 16;
+
+            gClyde[i].y = 112;
+            gClyde[i].x = 456 + (16 * i);
+            gClyde[i].w = 16;
+            gClyde[i].h = 16;
+        }
+
+        //set sprites for fleeing ghosts
+        for (int i = 0; i < 2; i++)
+        {
+            for (int j = 0; j < 4; j++)
+            {
+                int index = (4 * i) + j;
+                gMiscGhost[index].y = 64 + (16 * i);
+                gMiscGhost[index].x = 584 + (16 * j);
+                gMiscGhost[index].w = 16;
+                gMiscGhost[index].h = 16;
+            }
+        }
+
+        //set sprites for death sequence
+        for (int i = 0; i < 12; i++)
+        {
+            gPlayerDeath[i].y = 0;
+            gPlayerDeath[i].x = 488 + (16 * i);
+            gPlayerDeath[i].w = 16;
+            gPlayerDeath[i].h = 16;
+        }
+
+        //Cache the board in a texture, drawing tile by tile still works without one
+        if( !gBoardTexture.create() )
+        {
+            printf( "Warning: Board texture unavailable, drawing board per tile!\n" );
+        }
+	}
+
+	return success;
+}
+
+void close()
+{
+	//Stop sound
+	gAudio.close();
+
+	//Free loaded images
+	gSoftRenderer.free();
+	gBoardTexture.free();
+	gSpriteSheetTexture.free();
+
+	//Destroy window
+	SDL_DestroyRenderer( gRenderer );
+	SDL_DestroyWindow( gWindow );
+	gWindow = NULL;
+	gRenderer = NULL;
+
+	//Quit SDL subsystems
+	IMG_Quit();
+	SDL_Quit();
+}
+
+//the layouts Tile, Board and the entities had when ghost ai took them by value
+//frozen here so packing the real types doesn't shrink what the old convention is charged for
+struct LegacyTile
+{
+    bool hasCrossed;
+    bool goUp;
+    bool goDown;
+    bool goLeft;
+    bool goRight;
+};
+
+struct LegacyBoard
+{
+    LegacyTile tiles[BOARD_ROWS][BOARD_COLUMNS];
+};
+
+struct LegacyEntity
+{
+    int nextTurn;
+    int xLoc;
+    int yLoc;
+    int orientation;
+    bool mouthOpen;
+    bool scatterMode;
+    bool fleeMode;
+    bool eaten;
+};
+
+struct LegacyPlayer
+{
+    LegacyEntity entity;
+    int death;
+};
+
+//the by-value calling convention ghost ai used before World existed
+//called through volatile pointers so the copies cannot be optimised away
+static int copyBoardAndPlayer(LegacyBoard b, LegacyPlayer p)
+{
+    return b.tiles[11][13].goLeft + p.entity.xLoc;
+}
+
+static int copyBoard(LegacyBoard b)
+{
+    return b.tiles[11][13].goLeft;
+}
+
+static int copyBlinky(LegacyEntity blink)
+{
+    return blink.xLoc;
+}
+
+static int copyTile(LegacyTile t)
+{
+    return t.goLeft;
+}
+
+static int (*volatile gCopyBoardAndPlayer)(LegacyBoard, LegacyPlayer) = copyBoardAndPlayer;
+static int (*volatile gCopyBoard)(LegacyBoard) = copyBoard;
+static int (*volatile gCopyBlinky)(LegacyEntity) = copyBlinky;
+static int (*volatile gCopyTile)(LegacyTile) = copyTile;
+
+static void captureGame(const Game& game, GameState& state)
+{
+    game.capture(state);
+}
+
+static void restoreGame(Game& game, const GameState& state)
+{
+    game.restore(state);
+}
+
+static void (*volatile gCaptureGame)(const Game&, GameState&) = captureGame;
+static void (*volatile gRestoreGame)(Game&, const GameState&) = restoreGame;
+
+//Allocations made so far, counted so benchmarks can report allocations per operation
+static std::atomic<long> gAllocations(0);
+static std::atomic<long> gAllocatedBytes(0);
+
+#if PACMAN_COUNT_ALLOCATIONS
+void* operator new(size_t size)
+{
+    gAllocations.fetch_add(1, std::memory_order_relaxed);
+    gAllocatedBytes.fetch_add((long)size, std::memory_order_relaxed);
+    void* memory = malloc(size ? size : 1);
+    if (memory == NULL)
+    {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+//GCC inlines these into callers, then can't tell that new above is malloc and reports free() as a mismatch
+#if defined(__GNUC__) && __GNUC__ >= 11 && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void operator delete(void* memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+    free(memory);
+}
+
+#if defined(__GNUC__) && __GNUC__ >= 11 && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif
+
+//results land here so the optimiser can't drop the work
+static volatile int gBenchSink;
+
+//Times body(ops) with ops grown until a run takes at least 50ms, then prints ns, throughput and, when counted, allocations per op
+template <class Body>
+static void runBenchmark(const char* name, Body body, bool json, const char* filter)
+{
+    if (filter != NULL && strstr(name, filter) == NULL)
+    {
+        return;
+    }
+
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+    long ops = 1;
+    Uint64 elapsed;
+    long allocations;
+    long bytes;
+    while (true)
+    {
+        long allocationsBefore = gAllocations.load();
+        long bytesBefore = gAllocatedBytes.load();
+        Uint64 start = SDL_GetPerformanceCounter();
+        body(ops);
+        elapsed = SDL_GetPerformanceCounter() - start;
+        allocations = gAllocations.load() - allocationsBefore;
+        bytes = gAllocatedBytes.load() - bytesBefore;
+        if (elapsed * 20 >= frequency)
+        {
+            break;
+        }
+
+        //aim a little past 50ms, at least doubling each try
+        double scale = elapsed ? frequency / 16.0 / elapsed : 1000.0;
+        ops = (long)(ops * std::max(2.0, std::min(scale, 1000.0)));
+    }
+
+    double ns = (double)elapsed * 1e9 / frequency / ops;
+    if (json && PACMAN_COUNT_ALLOCATIONS)
+    {
+        printf("{\"name\":\"%s\",\"ns_per_op\":%.3f,\"ops_per_second\":%.0f,\"allocs_per_op\":%.4f,\"bytes_per_op\":%.1f,\"ops\":%ld}\n", name,
+               ns, 1e9 / ns, (double)allocations / ops, (double)bytes / ops, ops);
+    }
+    else if (json)
+    {
+        printf("{\"name\":\"%s\",\"ns_per_op\":%.3f,\"ops_per_second\":%.0f,\"ops\":%ld}\n", name, ns, 1e9 / ns, ops);
+    }
+    else if (PACMAN_COUNT_ALLOCATIONS)
+    {
+        printf("%-24s %10.2f ns/op %14.0f ops/s %8.3f allocs/op %10.1f B/op\n", name, ns, 1e9 / ns, (double)allocations / ops,
+               (double)bytes / ops);
+    }
+    else
+    {
+        printf("%-24s %10.2f ns/op %14.0f ops/s\n", name, ns, 1e9 / ns);
+    }
+    fflush(stdout);
+}
+
+//a tile centre for each walkable tile, where entities can be dropped
+static std::vector<int> walkableTiles()
+{
+    std::vector<int> tiles;
+    for (int i = 0; i < BOARD_TILES; i++)
+    {
+        if (mazeExits(MAZE, i / BOARD_COLUMNS, i % BOARD_COLUMNS))
+        {
+            tiles.push_back(i);
+        }
+    }
+    return tiles;
+}
+
+static void placeOnTile(Entity& entity, int tile)
+{
+    entity.setXLoc(8 * (tile % BOARD_COLUMNS) + 7);
+    entity.setYLoc(8 * (tile / BOARD_COLUMNS) + 5);
+}
+
+//times one ghost's decideTurn from every pairing of ghost and player tiles in turn
+template <class Ghost>
+static void benchmarkDecision(const char* name, int ai, bool json, const char* filter)
+{
+    std::vector<int> tiles = walkableTiles();
+    Board board;
+    Player player;
+    Blinky blinky;
+    Ghost ghost;
+    World world(board, player, blinky, ai);
+    runBenchmark(name, [&](long ops)
+    {
+        for (long i = 0; i < ops; i++)
+        {
+            placeOnTile(ghost, tiles[i % tiles.size()]);
+            placeOnTile(player, tiles[((size_t)i * 7919) % tiles.size()]);
+            placeOnTile(blinky, tiles[((size_t)i * 104729) % tiles.size()]);
+            ghost.setOrientation((int)(i >> 2) & 3);
+            ghost.decideTurn(world);
+            gBenchSink = ghost.nextTurn;
+        }
+    }, json, filter);
+}
+
+//points the software renderer at an offscreen surface and loads the sprites into it, false without pacman.png
+static bool startOffscreen(SDL_Surface*& surface)
+{
+    surface = SDL_CreateRGBSurfaceWithFormat(0, SCREEN_WIDTH, SCREEN_HEIGHT, 32, SDL_PIXELFORMAT_ARGB8888);
+    gRenderer = surface != NULL ? SDL_CreateSoftwareRenderer(surface) : NULL;
+    if (gRenderer != NULL && loadMedia())
+    {
+        return true;
+    }
+
+    gBoardTexture.free();
+    gSpriteSheetTexture.free();
+    if (gRenderer != NULL)
+    {
+        SDL_DestroyRenderer(gRenderer);
+        gRenderer = NULL;
+    }
+    SDL_FreeSurface(surface);
+    surface = NULL;
+    return false;
+}
+
+static void stopOffscreen(SDL_Surface* surface)
+{
+    gBoardTexture.free();
+    gSpriteSheetTexture.free();
+    SDL_DestroyRenderer(gRenderer);
+    gRenderer = NULL;
+    SDL_FreeSurface(surface);
+}
+
+int runBenchmarks( int argc, char* args[] )
+{
+    bool json = false;
+    const char* filter = NULL;
+    for( int i = 0; i < argc; i++ )
+    {
+        if( strcmp( args[ i ], "--json" ) == 0 )
+        {
+            json = true;
+        }
+        else if( strcmp( args[ i ], "--filter" ) == 0 && i + 1 < argc )
+        {
+            filter = args[ ++i ];
+        }
+    }
+
+    std::vector<int> tiles = walkableTiles();
+
+    runBenchmark("board_construct", [&](long ops)
+    {
+        for (long i = 0; i < ops; i++)
+        {
+            Board board;
+            gBenchSink = board.getCrossed((int)(i % BOARD_TILES));
+        }
+    }, json, filter);
+
+    {
+        //a ghost running the corridors, taking a different way out of each junction in turn
+        Board board;
+        Player player;
+        Blinky blinky;
+        World world(board, player, blinky);
+        Entity entity;
+        placeOnTile(entity, tiles[0]);
+        entity.setOrientation(RIGHT);
+        runBenchmark("entity_update", [&](long ops)
+        {
+            for (long i = 0; i < ops; i++)
+            {
+                int tile = (std::max(entity.getYLoc() - 4, 0) / 8) * BOARD_COLUMNS + std::max(entity.getXLoc() - 4, 0) / 8;
+                int turn = gJunctionGraph.corridorTurn(tile, entity.getOrientation());
+                if (turn == JunctionGraph::CHOICE)
+                {
+                    int ahead = board.getExits(tile) & ~(1 << reverseOf(entity.getOrientation()));
+                    turn = (i & 1) && (ahead & (ahead - 1)) ? lowestBit64((uint64_t)(ahead & (ahead - 1))) : lowestBit64((uint64_t)ahead);
+                }
+                entity.setNextTurn(turn);
+                entity.update(world);
+                gBenchSink = entity.getXLoc();
+            }
+        }, json, filter);
+    }
+
+    benchmarkDecision<Blinky>("decide_turn_blinky", ARCADE_AI, json, filter);
+    benchmarkDecision<Pinky>("decide_turn_pinky", ARCADE_AI, json, filter);
+    benchmarkDecision<Inky>("decide_turn_inky", ARCADE_AI, json, filter);
+    benchmarkDecision<Clyde>("decide_turn_clyde", ARCADE_AI, json, filter);
+    benchmarkDecision<Blinky>("decide_turn_blinky_path", PATH_AI, json, filter);
+
+    {
+        //player visiting tiles in a scattered order, board wiped after each full lap
+        Board board;
+        Player player;
+        runBenchmark("board_update", [&](long ops)
+        {
+            for (long i = 0; i < ops; i++)
+            {
+                size_t step = (size_t)i % tiles.size();
+                if (step == 0)
+                {
+                    board = Board();
+                }
+                placeOnTile(player, tiles[(step * 7919) % tiles.size()]);
+                gBenchSink = board.updateBoard(player);
+            }
+        }, json, filter);
+    }
+
+    {
+        //player against each ghost position, the way Game::step checks collisions
+        Player player;
+        std::vector<Blinky> ghosts(64);
+        for (size_t g = 0; g < ghosts.size(); g++)
+        {
+            placeOnTile(ghosts[g], tiles[(g * 37) % tiles.size()]);
+        }
+        runBenchmark("sharing_tile", [&](long ops)
+        {
+            int shared = 0;
+            for (long i = 0; i < ops; i++)
+            {
+                placeOnTile(player, tiles[(size_t)i % tiles.size()]);
+                shared += player.sharingTile(ghosts[i & 63]);
+            }
+            gBenchSink = shared;
+        }, json, filter);
+    }
+
+    for (int ai = ARCADE_AI; ai <= PATH_AI; ai++)
+    {
+        //whole headless ticks of a bot game, starting over when the player dies
+        Game game(ai);
+        uint32_t seed = 5;
+        runBenchmark(ai == ARCADE_AI ? "game_step" : "game_step_path", [&](long ops)
+        {
+            for (long i = 0; i < ops; i++)
+            {
+                int action = botAction(seed);
+                if (action != DEFAULT)
+                {
+                    game.steer(action);
+                }
+                if (!game.step())
+                {
+                    game = Game(ai);
+                }
+            }
+            gBenchSink = game.getFrame();
+        }, json, filter);
+    }
+
+    //one ghost sized colour keyed blit, half the source pixels black, no sprite sheet needed
+    {
+        std::vector<uint32_t> sprite(16 * 16);
+        std::vector<uint32_t> target((size_t)SCREEN_WIDTH * SCREEN_HEIGHT, 0xFF000000);
+        for (size_t i = 0; i < sprite.size(); i++)
+        {
+            sprite[i] = (i * 7) % 2 ? 0xFFFF0000 : 0xFF000000;
+        }
+        runBenchmark("blit_keyed_16x16", [&](long ops)
+        {
+            for (long i = 0; i < ops; i++)
+            {
+                int x = (int)(i % (SCREEN_WIDTH - 16));
+                SoftRenderer::blitKeyed(&target[(size_t)(x % (SCREEN_HEIGHT - 16)) * SCREEN_WIDTH + x], SCREEN_WIDTH, &sprite[0], 16, 16, 16);
+            }
+            gBenchSink = target[(size_t)SCREEN_WIDTH * 8 + 8];
+        }, json, filter);
+    }
+
+    //one audio callback's worth of mixing with every voice looping, no device needed
+    {
+        AudioMixer mixer;
+        std::vector<int16_t> clip(AudioMixer::FREQUENCY / 3);
+        for (size_t i = 0; i < clip.size(); i++)
+        {
+            clip[i] = (int16_t)((i * 37) % 20000 - 10000);
+        }
+        for (int s = 0; s < SOUNDS; s++)
+        {
+            mixer.setClip(s, clip);
+            mixer.send(s, SOUND_LOOP);
+        }
+        int16_t buffer[AudioMixer::BUFFER_FRAMES];
+        runBenchmark("audio_mix", [&](long ops)
+        {
+            for (long i = 0; i < ops; i++)
+            {
+                mixer.mix(buffer, AudioMixer::BUFFER_FRAMES);
+            }
+            gBenchSink = buffer[(size_t)ops % AudioMixer::BUFFER_FRAMES];
+        }, json, filter);
+    }
+
+    //rendering goes through SDL's software renderer into a surface, so no window or GPU is needed
+    SDL_Surface* surface;
+    if (startOffscreen(surface))
+    {
+        Game game;
+        EntityPositions positions;
+        capturePositions(game, positions);
+        runBenchmark("render_board_full", [&](long ops)
+        {
+            for (long i = 0; i < ops; i++)
+            {
+                gBoardTexture.invalidate();
+                gBoardTexture.render(game.getBoard());
+            }
+        }, json, filter);
+        //a pellet eaten each frame while the last one comes back, so two tiles are redrawn per render
+        Board eating;
+        uint64_t fresh[BOARD_WORDS];
+        eating.capture(fresh);
+        runBenchmark("render_board_cached", [&](long ops)
+        {
+            for (long i = 0; i < ops; i++)
+            {
+                eating.restore(fresh);
+                eating.crossOff(tiles[(size_t)i % tiles.size()]);
+                gBoardTexture.render(eating);
+            }
+        }, json, filter);
+        runBenchmark("render_frame", [&](long ops)
+        {
+            for (long i = 0; i < ops; i++)
+            {
+                SDL_SetRenderDrawColor(gRenderer, 0, 0, 0, 0);
+                SDL_RenderClear(gRenderer);
+                renderGame(game, positions, 0.5f);
+            }
+        }, json, filter);
+
+        //the same frames composed on the CPU and uploaded once, compare with the two above
+        if (gSoftRenderer.create("pacman.png"))
+        {
+            runBenchmark("render_board_soft_full", [&](long ops)
+            {
+                for (long i = 0; i < ops; i++)
+                {
+                    gSoftRenderer.invalidate();
+                    gSoftRenderer.renderBoard(game.getBoard());
+                }
+            }, json, filter);
+            runBenchmark("render_frame_soft", [&](long ops)
+            {
+                for (long i = 0; i < ops; i++)
+                {
+                    SDL_SetRenderDrawColor(gRenderer, 0, 0, 0, 0);
+                    SDL_RenderClear(gRenderer);
+                    renderGame(game, positions, 0.5f);
+                    gSoftRenderer.present();
+                }
+            }, json, filter);
+            gSoftRenderer.free();
+        }
+        stopOffscreen(surface);
+    }
+    else if (!json)
+    {
+        printf("rendering benchmarks skipped, pacman.png is needed in the working directory\n");
+    }
+
+    //the longer reports behind earlier changes, for people rather than scripts
+    if (!json && filter == NULL)
+    {
+        printf("\n");
+        benchmarkWorldCopies();
+        benchmarkGhostDecisions();
+        benchmarkJunctionGraph();
+        benchmarkSwarm();
+        benchmarkBatch();
+        benchmarkSnapshots();
+        benchmarkRewind();
+    }
+
+    return 0;
+}
+
+void benchmarkWorldCopies()
+{
+    const int ticks = 200000;
+
+    Board board;
+    Player player;
+    Blinky blinky;
+    Pinky pinky;
+    Inky inky;
+    World world(board, player, blinky);
+
+    //one ghost tick used to copy the board six times (three decideTurn, three update),
+    //the player three times, blinky once for inky, and a tile per getTile call
+    //sizes are the old ones, the by-value path copies these same legacy objects
+    LegacyBoard legacyBoard;
+    LegacyPlayer legacyPlayer;
+    LegacyEntity legacyBlinky;
+    memset(&legacyBoard, 0, sizeof(legacyBoard));
+    memset(&legacyPlayer, 0, sizeof(legacyPlayer));
+    memset(&legacyBlinky, 0, sizeof(legacyBlinky));
+    int tileCopies = 3 + 3 * 3;
+    unsigned long bytesBefore = 6 * sizeof(LegacyBoard) + 3 * sizeof(LegacyPlayer) + sizeof(LegacyEntity) + tileCopies * sizeof(LegacyTile);
+
+    int sink = 0;
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+
+    //old calling convention: same work plus the argument copies
+    Uint64 start = SDL_GetPerformanceCounter();
+    for (int i = 0; i < ticks; i++)
+    {
+        sink += gCopyBoardAndPlayer(legacyBoard, legacyPlayer);
+        blinky.decideTurn(world);
+        sink += gCopyBoard(legacyBoard);
+        blinky.update(world);
+        sink += gCopyBoardAndPlayer(legacyBoard, legacyPlayer);
+        pinky.decideTurn(world);
+        sink += gCopyBoard(legacyBoard);
+        pinky.update(world);
+        sink += gCopyBoardAndPlayer(legacyBoard, legacyPlayer) + gCopyBlinky(legacyBlinky);
+        inky.decideTurn(world);
+        sink += gCopyBoard(legacyBoard);
+        inky.update(world);
+        for (int j = 0; j < tileCopies; j++)
+        {
+            sink += gCopyTile(legacyBoard.tiles[11][13]);
+        }
+    }
+    double before = (double)(SDL_GetPerformanceCounter() - start) * 1e9 / frequency / ticks;
+
+    //current calling convention: everything goes through the world view
+    start = SDL_GetPerformanceCounter();
+    for (int i = 0; i < ticks; i++)
+    {
+        blinky.decideTurn(world);
+        blinky.update(world);
+        pinky.decideTurn(world);
+        pinky.update(world);
+        inky.decideTurn(world);
+        inky.update(world);
+    }
+    double after = (double)(SDL_GetPerformanceCounter() - start) * 1e9 / frequency / ticks;
+
+    printf("ghost tick, by value: %8.1f ns/tick %8lu bytes copied/tick (pre-World layouts)\n", before, bytesBefore);
+    printf("ghost tick, by world: %8.1f ns/tick %8d bytes copied/tick (by construction, World only holds references)\n", after, 0);
+
+    //keeps the compiler from discarding the by-value calls
+    if (sink == -1)
+    {
+        printf("\n");
+    }
+}
+
+void capturePositions( const Game& game, EntityPositions& positions )
+{
+    const Entity* entities[4] = { &game.getPlayer(), &game.getBlinky(), &game.getPinky(), &game.getInky() };
+    for (int i = 0; i < 4; i++)
+    {
+        positions.x[i] = entities[i]->getXLoc();
+        positions.y[i] = entities[i]->getYLoc();
+    }
+}
+
+bool playTick( BatchEnv& env, int& action, bool rewinding, ReplayFile* replay, ReplayWriter& recorder, RewindBuffer* rewind,
+               int endTick, EntityPositions& previous, int& events )
+{
+    //a replay stops on the tick its recording did
+    const Game& game = env.getGame( 0 );
+    if( endTick >= 0 && game.getFrame() >= endTick )
+    {
+        return false;
+    }
+
+    //step back a tick instead, the board picks up the pellets that come back by itself
+    if( rewinding )
+    {
+        GameState state;
+        if( rewind->pop( state ) )
+        {
+            capturePositions( game, previous );
+            env.restore( 0, state );
+        }
+        return true;
+    }
+    if( rewind != NULL )
+    {
+        rewind->push( game );
+    }
+
+    if( replay != NULL )
+    {
+        action = replay->turnAt( game.getFrame() );
+    }
+    if( action != DEFAULT && recorder.isOpen() )
+    {
+        recorder.append( game.getFrame(), action );
+    }
+
+    capturePositions( game, previous );
+    env.step( &action );
+    action = DEFAULT;
+    events |= game.getEvents();
+    return !env.getDone()[ 0 ];
+}
+
+//blends one coordinate between two steps
+static int interpolate(int from, int to, float alpha)
+{
+    //don't slide across the screen when wrapping through the tunnel
+    if (abs(to - from) > 8)
+    {
+        return to;
+    }
+    return from + (int)((to - from) * alpha + (to > from ? 0.5f : -0.5f));
+}
+
+//draws clip of the sprite sheet with whichever renderer is in use
+static void renderSprite(int x, int y, SDL_Rect* clip)
+{
+    if (gSoftRenderer.isActive())
+    {
+        gSoftRenderer.renderSprite(x, y, clip);
+    }
+    else
+    {
+        gSpriteSheetTexture.render(x, y, clip);
+    }
+}
+
+//draws a ghost with its own sprites, or the shared flee/eaten ones
+static void renderGhost(const Entity& ghost, int x, int y, SDL_Rect* sprites, int frame, int fleeFrame)
+{
+    if (ghost.getEaten())
+    {
+        int c = ghost.getOrientation() + 4;
+        renderSprite(x - 10, y - 8, &gMiscGhost[c]);
+    }
+    else if (ghost.getFlee())
+    {
+        if (frame > fleeFrame + 420 && (frame / 20) % 2 == 0) //ghosts will blink near end of flee mode
+        {
+            renderSprite(x - 10, y - 8, &gMiscGhost[ghost.getMouthOpen() + 2]);
+        }
+        else
+        {
+            renderSprite(x - 10, y - 8, &gMiscGhost[ghost.getMouthOpen()]);
+        }
+    }
+    else
+    {
+        renderSprite(x - 10, y - 8, &sprites[ghost.currentSprite()]);
+    }
+}
+
+void renderGame( const Game& game, const EntityPositions& previous, float alpha )
+{
+    //positions between the last two steps
+    EntityPositions current;
+    capturePositions(game, current);
+    int x[4];
+    int y[4];
+    for (int i = 0; i < 4; i++)
+    {
+        x[i] = interpolate(previous.x[i], current.x[i], alpha);
+        y[i] = interpolate(previous.y[i], current.y[i], alpha);
+    }
+
+    //Render game board
+    {
+        PROFILE_SCOPE(PROFILE_BOARD_RENDER);
+        if (gSoftRenderer.isActive())
+        {
+            gSoftRenderer.renderBoard(game.getBoard());
+        }
+        else
+        {
+            gBoardTexture.render(game.getBoard());
+        }
+    }
+
+    PROFILE_SCOPE(PROFILE_SPRITES);
+
+    //Render player
+    //offset sprite, x and y location refer to center of player
+    const Player& player = game.getPlayer();
+    if (player.getDeathState())
+    {
+        renderSprite(x[0] - 10, y[0] - 8, &gPlayerDeath[player.getDeathState()]);
+    }
+    else
+    {
+        renderSprite(x[0] - 10, y[0] - 8, &gPlayer[player.currentSprite()]);
+    }
+
+    //render ghosts
+    renderGhost(game.getBlinky(), x[1], y[1], gBlinky, game.getFrame(), game.getFleeFrame());
+    renderGhost(game.getPinky(), x[2], y[2], gPinky, game.getFrame(), game.getFleeFrame());
+    renderGhost(game.getInky(), x[3], y[3], gInky, game.getFrame(), game.getFleeFrame());
+}
+
+void requestSummary( int signal )
+{
+    (void)signal;
+    gSummaryRequested = 1;
+}
+
+//direction an arrow key turns the player, DEFAULT for other keys
+static int arrowDirection( SDL_Keycode key )
+{
+    switch( key )
+    {
+        case SDLK_RIGHT:
+        return RIGHT;
+
+        case SDLK_LEFT:
+        return LEFT;
+
+        case SDLK_UP:
+        return UP;
+
+        case SDLK_DOWN:
+        return DOWN;
+
+        default:
+        return DEFAULT;
+    }
+}
+
+//queues sound effects for what happened to game since the last frame, pellets is how many were left then
+static void playSounds( const Game& game, int events, int& pellets )
+{
+    //each chomp starts as the mouth shuts, so the waka stays on the sprite's beat
+    if( events & GAME_CHOMP )
+    {
+        gAudio.send( SOUND_CHOMP, SOUND_PLAY );
+    }
+
+    //a new game or a rewind, the siren comes back if a death stopped it
+    int left = game.getBoard().pelletsLeft();
+    if( left > pellets )
+    {
+        gAudio.send( SOUND_SIREN, SOUND_LOOP );
+    }
+    pellets = left;
+
+    if( events & GAME_ENERGIZER )
+    {
+        gAudio.send( SOUND_ENERGIZER, SOUND_PLAY );
+    }
+    if( events & GAME_GHOST_EATEN )
+    {
+        gAudio.send( SOUND_GHOST_EATEN, SOUND_PLAY );
+    }
+    if( events & GAME_DEATH )
+    {
+        gAudio.send( SOUND_SIREN, SOUND_STOP );
+        gAudio.send( SOUND_CHOMP, SOUND_STOP );
+        gAudio.send( SOUND_DEATH, SOUND_PLAY );
+    }
+}
+
+//performance counter at an SDL event timestamp, which only has millisecond resolution
+static Uint64 eventTime( Uint32 timestamp )
+{
+    Uint64 now = SDL_GetPerformanceCounter();
+    Sint32 age = (Sint32)( SDL_GetTicks() - timestamp );
+    Uint64 back = (Uint64)std::max( age, 0 ) * SDL_GetPerformanceFrequency() / 1000;
+    return back < now ? now - back : 0;
+}
+
+void renderProfile()
+{
+    //one bar per phase, 12 pixels a millisecond so a 60Hz frame spans most of the screen, p99 as a white tick
+    static const Uint8 colours[PROFILE_PHASES][3] = { { 255, 184, 82 }, { 33, 33, 255 }, { 255, 184, 174 }, { 255, 255, 0 },
+                                                      { 255, 0, 0 }, { 0, 255, 255 }, { 255, 184, 255 }, { 0, 255, 0 },
+                                                      { 160, 160, 160 } };
+    SDL_Rect background = { 0, 0, SCREEN_WIDTH, PROFILE_PHASES * 4 + 2 };
+    SDL_SetRenderDrawColor( gRenderer, 0, 0, 0, 255 );
+    SDL_RenderFillRect( gRenderer, &background );
+    for( int p = 0; p < PROFILE_PHASES; p++ )
+    {
+        float min, avg, p99;
+        gProfiler.getStats( p, min, avg, p99 );
+
+        SDL_Rect bar = { 1, 1 + p * 4, std::min( (int)( avg * 12 ), SCREEN_WIDTH - 2 ), 3 };
+        SDL_SetRenderDrawColor( gRenderer, colours[ p ][ 0 ], colours[ p ][ 1 ], colours[ p ][ 2 ], 255 );
+        SDL_RenderFillRect( gRenderer, &bar );
+
+        SDL_Rect tick = { 1 + std::min( (int)( p99 * 12 ), SCREEN_WIDTH - 3 ), 1 + p * 4, 1, 3 };
+        SDL_SetRenderDrawColor( gRenderer, 255, 255, 255, 255 );
+        SDL_RenderFillRect( gRenderer, &tick );
+    }
+}
+
+int displayRefreshRate()
+{
+    SDL_DisplayMode mode;
+    if( SDL_GetCurrentDisplayMode( SDL_GetWindowDisplayIndex( gWindow ), &mode ) != 0 || mode.refresh_rate <= 0 )
+    {
+        //unknown, assume the rate the game was designed for
+        return TICKS_PER_SECOND;
+    }
+    return mode.refresh_rate;
+}
+
+void benchmarkGhostDecisions()
+{
+    //ghosts and player dropped on every pair of walkable tile centres in turn
+    std::vector<int> tiles;
+    for (int i = 0; i < BOARD_TILES; i++)
+    {
+        if (mazeExits(MAZE, i / BOARD_COLUMNS, i % BOARD_COLUMNS))
+        {
+            tiles.push_back(i);
+        }
+    }
+
+    const int decisions = 300000;
+    const char* names[2] = { "arcade", "path" };
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+    for (int ai = ARCADE_AI; ai <= PATH_AI; ai++)
+    {
+        Board board;
+        Player player;
+        Blinky blinky;
+        Pinky pinky;
+        Inky inky;
+        World world(board, player, blinky, ai);
+
+        //positioning is a handful of stores, cheap next to a decision, so it stays in the timed loop
+        int checksum = 0;
+        Uint64 start = SDL_GetPerformanceCounter();
+        for (int i = 0; i < decisions; i++)
+        {
+            //tile centres sit at 8 * column + 7, 8 * row + 5
+            int ghostTile = tiles[i % tiles.size()];
+            int playerTile = tiles[((size_t)i * 7919) % tiles.size()];
+            player.setXLoc(8 * (playerTile % BOARD_COLUMNS) + 7);
+            player.setYLoc(8 * (playerTile / BOARD_COLUMNS) + 5);
+            player.setOrientation(i & 3);
+            Entity* ghosts[3] = { &blinky, &pinky, &inky };
+            for (int g = 0; g < 3; g++)
+            {
+                ghosts[g]->setXLoc(8 * (ghostTile % BOARD_COLUMNS) + 7);
+                ghosts[g]->setYLoc(8 * (ghostTile / BOARD_COLUMNS) + 5);
+                ghosts[g]->setOrientation((i >> 2) & 3);
+                ghosts[g]->setFlee((i & 15) == 0);
+            }
+
+            blinky.decideTurn(world);
+            pinky.decideTurn(world);
+            inky.decideTurn(world);
+            checksum += blinky.nextTurn + pinky.nextTurn + inky.nextTurn;
+        }
+        Uint64 elapsed = SDL_GetPerformanceCounter() - start;
+
+        printf("ghost decision, %-6s: %8.1f ns/decision (checksum %d)\n", names[ai],
+               (double)elapsed * 1e9 / frequency / (3.0 * decisions), checksum);
+    }
+}
+
+void benchmarkJunctionGraph()
+{
+    int edges = 0;
+    int corridorTiles = 0;
+    for (int n = 0; n < gJunctionGraph.getNodeCount(); n++)
+    {
+        for (int dir = 0; dir < 4; dir++)
+        {
+            if (gJunctionGraph.getNeighbour(n, dir) >= 0)
+            {
+                edges++;
+                corridorTiles += gJunctionGraph.getLength(n, dir);
+            }
+        }
+    }
+
+    //share of the places a moving ghost can be that still need targeting
+    int states = 0;
+    int choices = 0;
+    for (int index = 0; index < BOARD_TILES; index++)
+    {
+        int exits = mazeExits(MAZE, index / BOARD_COLUMNS, index % BOARD_COLUMNS);
+        for (int dir = 0; dir < 4; dir++)
+        {
+            //an entity heading in dir arrived through the opposite exit
+            if ((exits >> reverseOf(dir)) & 1)
+            {
+                states++;
+                choices += gJunctionGraph.corridorTurn(index, dir) == JunctionGraph::CHOICE;
+            }
+        }
+    }
+
+    printf("junction graph: %d junctions, %d directed corridors, %.1f tiles per corridor\n", gJunctionGraph.getNodeCount(), edges,
+           edges ? (double)corridorTiles / edges : 0.0);
+    printf("junction graph: %d of %d tile/heading states need targeting (%.1f%%)\n", choices, states, 100.0 * choices / states);
+}
+
+//drops count entities on random tile centres of the maze
+static void spawnSwarm(EntityStore& store, int count, uint32_t seed)
+{
+    std::vector<int> tiles;
+    for (int i = 0; i < BOARD_TILES; i++)
+    {
+        if (mazeExits(MAZE, i / BOARD_COLUMNS, i % BOARD_COLUMNS))
+        {
+            tiles.push_back(i);
+        }
+    }
+    for (int i = 0; i < count; i++)
+    {
+        int tile = tiles[nextRandom(seed) % tiles.size()];
+        int exits = mazeExits(MAZE, tile / BOARD_COLUMNS, tile % BOARD_COLUMNS);
+        int dir = lowestBit64((uint64_t)exits);
+        store.add(8 * (tile % BOARD_COLUMNS) + 7, 8 * (tile / BOARD_COLUMNS) + 5, dir);
+    }
+}
+
+//swarm ghosts follow corridors and take a random way on at junctions
+static void wanderSwarm(EntityStore& store, uint32_t& seed)
+{
+    for (int i = 0; i < store.size(); i++)
+    {
+        int tile = store.getTile(i);
+        int turn = gJunctionGraph.corridorTurn(tile, store.getOrientation(i));
+        if (turn == JunctionGraph::CHOICE)
+        {
+            int ahead = mazeExits(MAZE, tile / BOARD_COLUMNS, tile % BOARD_COLUMNS) & ~(1 << reverseOf(store.getOrientation(i)));
+            int pick = nextRandom(seed) % popcount64((uint64_t)ahead);
+            while (pick--)
+            {
+                ahead &= ahead - 1;
+            }
+            turn = lowestBit64((uint64_t)ahead);
+        }
+        store.setNextTurn(i, turn);
+    }
+}
+
+void benchmarkSwarm()
+{
+    const int ghosts = 1024;
+    const int ticks = 2000;
+
+    EntityStore store;
+    spawnSwarm(store, ghosts, 12345);
+
+    //the same swarm as one object per ghost
+    std::vector<Entity> objects(ghosts);
+    for (int i = 0; i < ghosts; i++)
+    {
+        objects[i].setXLoc(store.getXLoc(i));
+        objects[i].setYLoc(store.getYLoc(i));
+        objects[i].setOrientation(store.getOrientation(i));
+    }
+
+    Board board;
+    Player player;
+    Blinky blinky;
+    World world(board, player, blinky);
+
+    uint32_t seed = 99;
+    Uint64 objectTime = 0;
+    Uint64 storeTime = 0;
+    for (int t = 0; t < ticks; t++)
+    {
+        wanderSwarm(store, seed);
+        for (int i = 0; i < ghosts; i++)
+        {
+            objects[i].setNextTurn(store.getNextTurn(i));
+        }
+
+        Uint64 start = SDL_GetPerformanceCounter();
+        for (int i = 0; i < ghosts; i++)
+        {
+            objects[i].update(world);
+        }
+        Uint64 middle = SDL_GetPerformanceCounter();
+        store.update(board);
+        Uint64 end = SDL_GetPerformanceCounter();
+
+        objectTime += middle - start;
+        storeTime += end - middle;
+    }
+
+    //both have to end up in exactly the same place
+    int mismatches = 0;
+    for (int i = 0; i < ghosts; i++)
+    {
+        if (objects[i].getXLoc() != store.getXLoc(i) || objects[i].getYLoc() != store.getYLoc(i) ||
+            objects[i].getOrientation() != store.getOrientation(i) || objects[i].getMouthOpen() != ((store.getFlags(i) & MOUTH_OPEN) != 0))
+        {
+            mismatches++;
+        }
+    }
+
+    double frequency = (double)SDL_GetPerformanceFrequency();
+    printf("swarm of %d, objects: %8.2f ns/entity update\n", ghosts, objectTime * 1e9 / frequency / ((double)ghosts * ticks));
+    printf("swarm of %d, store:   %8.2f ns/entity update (%d mismatches)\n", ghosts, storeTime * 1e9 / frequency / ((double)ghosts * ticks), mismatches);
+}
+
+void benchmarkBatch()
+{
+    const int sizes[3] = { 1, 64, 1024 };
+    const long framesPerSize = 2000000;
+    for (int s = 0; s < 3; s++)
+    {
+        BatchEnv env(sizes[s]);
+        std::vector<int> actions(sizes[s]);
+        uint32_t seed = 7;
+        int steps = (int)(framesPerSize / sizes[s]);
+
+        Uint64 start = SDL_GetPerformanceCounter();
+        for (int t = 0; t < steps; t++)
+        {
+            for (int i = 0; i < sizes[s]; i++)
+            {
+                actions[i] = botAction(seed);
+            }
+            env.step(actions.data());
+        }
+        double seconds = (double)(SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+
+        printf("batch of %4d: %10.0f frames/s, %ld games finished, %d bytes per game\n", sizes[s],
+               (double)steps * sizes[s] / seconds, env.getEpisodes(), (int)sizeof(Game));
+    }
+}
+
+void benchmarkSnapshots()
+{
+    //a game restored from every frame of bot games has to play the next frame exactly like the original
+    int frames = 0;
+    int mismatches = 0;
+    uint32_t seed = 3;
+    for (int g = 0; g < 50; g++)
+    {
+        Game game;
+        Game shadow;
+        bool running = true;
+        while (running)
+        {
+            GameState before;
+            GameState after;
+            GameState check;
+            game.capture(before);
+            shadow.restore(before);
+            shadow.capture(check);
+            mismatches += memcmp(&before, &check, sizeof(GameState)) != 0;
+
+            int action = botAction(seed);
+            if (action != DEFAULT)
+            {
+                game.steer(action);
+                shadow.steer(action);
+            }
+            running = game.step();
+            shadow.step();
+            game.capture(after);
+            shadow.capture(check);
+            mismatches += memcmp(&after, &check, sizeof(GameState)) != 0;
+            frames++;
+        }
+    }
+
+    const int repeats = 5000000;
+    Game game;
+    GameState state;
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+
+    Uint64 start = SDL_GetPerformanceCounter();
+    for (int i = 0; i < repeats; i++)
+    {
+        gCaptureGame(game, state);
+    }
+    Uint64 captureTime = SDL_GetPerformanceCounter() - start;
+
+    start = SDL_GetPerformanceCounter();
+    for (int i = 0; i < repeats; i++)
+    {
+        gRestoreGame(game, state);
+    }
+    Uint64 restoreTime = SDL_GetPerformanceCounter() - start;
+
+    printf("snapshot: %d bytes, capture %.1f ns, restore %.1f ns (%d frames round-tripped, %d mismatches)\n",
+           (int)sizeof(GameState), (double)captureTime * 1e9 / frequency / repeats, (double)restoreTime * 1e9 / frequency / repeats,
+           frames, mismatches);
+}
+
+void benchmarkRewind()
+{
+    //bot games back to back, long enough to wrap the buffer a few times
+    const int ticks = 10000;
+    std::vector<GameState> history(ticks);
+    RewindBuffer rewind;
+    Game game;
+    uint32_t seed = 11;
+    Uint64 pushTime = 0;
+    for (int t = 0; t < ticks; t++)
+    {
+        game.capture(history[t]);
+        Uint64 start = SDL_GetPerformanceCounter();
+        rewind.push(game);
+        pushTime += SDL_GetPerformanceCounter() - start;
+
+        int action = botAction(seed);
+        if (action != DEFAULT)
+        {
+            game.steer(action);
+        }
+        if (!game.step())
+        {
+            game = Game();
+        }
+    }
+
+    int held = rewind.getTicks();
+    size_t deltaBytes = rewind.getDeltaBytes();
+
+    //has to give back exactly the newest held ticks, newest first
+    int mismatches = 0;
+    int popped = 0;
+    GameState state;
+    Uint64 start = SDL_GetPerformanceCounter();
+    while (rewind.pop(state))
+    {
+        popped++;
+        mismatches += memcmp(&state, &history[ticks - popped], sizeof(GameState)) != 0;
+    }
+    Uint64 popTime = SDL_GetPerformanceCounter() - start;
+
+    double frequency = (double)SDL_GetPerformanceFrequency();
+    printf("rewind: %d KB, %d ticks held (%.1f s), %.1f delta bytes/tick, push %.1f ns, pop %.1f ns (%d mismatches)\n",
+           (int)(rewind.getMemory() / 1024), held, (double)held / TICKS_PER_SECOND, (double)deltaBytes / held,
+           pushTime * 1e9 / frequency / ticks, popTime * 1e9 / frequency / popped, mismatches + (popped != held));
+}
+
+//totals of a BatchRunner run, folded in game order so they never depend on scheduling
+struct BatchTotals
+{
+    long frames;
+    long pellets;
+    long deaths;
+    uint64_t hash;
+};
+
+static BatchTotals totalResults(const std::vector<GameResult>& results)
+{
+    BatchTotals totals = { 0, 0, 0, 0xcbf29ce484222325ULL };
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        totals.frames += results[i].frames;
+        totals.pellets += results[i].pellets;
+        totals.deaths += results[i].died;
+        totals.hash = (totals.hash ^ (uint64_t)results[i].frames) * 0x100000001b3ULL;
+        totals.hash = (totals.hash ^ (uint64_t)results[i].pellets) * 0x100000001b3ULL;
+    }
+    return totals;
+}
+
+int runBatch( int argc, char* args[] )
+{
+    int games = argc > 0 ? atoi( args[ 0 ] ) : 0;
+    int threads = 0;
+    uint32_t seed = 1;
+    int maxFrames = 60 * 60 * 5;
+    for( int i = 1; i + 1 < argc; i++ )
+    {
+        if( strcmp( args[ i ], "--threads" ) == 0 )
+        {
+            threads = atoi( args[ ++i ] );
+        }
+        else if( strcmp( args[ i ], "--seed" ) == 0 )
+        {
+            seed = (uint32_t)strtoul( args[ ++i ], NULL, 10 );
+        }
+        else if( strcmp( args[ i ], "--frames" ) == 0 )
+        {
+            maxFrames = atoi( args[ ++i ] );
+        }
+    }
+    if( games <= 0 )
+    {
+        printf( "usage: pacman --batch N [--threads T] [--seed S] [--frames F] [--ai arcade|path]\n" );
+        return 1;
+    }
+    int ai = ghostAIOption( argc, args );
+    if( ai < 0 )
+    {
+        return 1;
+    }
+
+    //without --threads, measure scaling by doubling up to every core
+    //a single thread always runs first, so speedups are against it
+    std::vector<int> counts( 1, 1 );
+    if( threads > 1 )
+    {
+        counts.push_back( threads );
+    }
+    else if( threads <= 0 )
+    {
+        int cores = std::max( 1, (int)std::thread::hardware_concurrency() );
+        for( int t = 2; t < cores; t *= 2 )
+        {
+            counts.push_back( t );
+        }
+        if( cores > 1 )
+        {
+            counts.push_back( cores );
+        }
+    }
+
+    BatchTotals first = { 0, 0, 0, 0 };
+    double baseline = 0;
+    for( size_t c = 0; c < counts.size(); c++ )
+    {
+        BatchRunner runner( counts[ c ] );
+        std::vector<GameResult> results;
+        Uint64 start = SDL_GetPerformanceCounter();
+        runner.run( games, seed, ai, maxFrames, results );
+        double seconds = (double)( SDL_GetPerformanceCounter() - start ) / SDL_GetPerformanceFrequency();
+
+        BatchTotals totals = totalResults( results );
+        if( c == 0 )
+        {
+            first = totals;
+            baseline = games / seconds;
+            printf( "%d games, %ld frames, %ld pellets, %ld deaths, results %016llx\n", games, totals.frames, totals.pellets,
+                    totals.deaths, (unsigned long long)totals.hash );
+        }
+
+        double rate = games / seconds;
+        printf( "%2d threads: %9.0f games/s, %11.0f frames/s, %5.2fx, %5.1f%% per core, %ld steals%s\n", counts[ c ], rate,
+                totals.frames / seconds, rate / baseline, 100.0 * rate / baseline / counts[ c ], runner.getSteals(),
+                totals.hash == first.hash ? "" : ", RESULTS DIFFER" );
+    }
+
+    return 0;
+}
+
+int runSwarm( int argc, char* args[] )
+{
+    int ghosts = argc > 0 ? atoi( args[ 0 ] ) : 0;
+    int frames = 60 * 60;
+    for( int i = 1; i + 1 < argc; i++ )
+    {
+        if( strcmp( args[ i ], "--frames" ) == 0 )
+        {
+            frames = atoi( args[ ++i ] );
+        }
+    }
+    if( ghosts <= 0 )
+    {
+        printf( "usage: pacman --swarm N [--frames F]\n" );
+        return 1;
+    }
+
+    Board board;
+    EntityStore store;
+    spawnSwarm( store, ghosts, 12345 );
+
+    uint32_t seed = 99;
+    Uint64 start = SDL_GetPerformanceCounter();
+    for( int frame = 0; frame < frames; frame++ )
+    {
+        wanderSwarm( store, seed );
+        store.update( board );
+    }
+    double seconds = (double)( SDL_GetPerformanceCounter() - start ) / SDL_GetPerformanceFrequency();
+    printf( "%d ghosts for %d frames in %.3f s (%.0f entity updates/s)\n", ghosts, frames, seconds, (double)ghosts * frames / seconds );
+
+    return 0;
+}
+
+int ghostAIOption( int argc, char* args[] )
+{
+    const char* value = stringOption( argc, args, "--ai" );
+    if( value == NULL || strcmp( value, "arcade" ) == 0 )
+    {
+        return ARCADE_AI;
+    }
+    if( strcmp( value, "path" ) == 0 )
+    {
+        return PATH_AI;
+    }
+    printf( "Unknown ghost ai %s, usage: --ai arcade|path\n", value );
+    return -1;
+}
+
+const char* stringOption( int argc, char* args[], const char* name )
+{
+    for( int i = 0; i + 1 < argc; i++ )
+    {
+        if( strcmp( args[ i ], name ) == 0 )
+        {
+            return args[ i + 1 ];
+        }
+    }
+    return NULL;
+}
+
+bool flagOption( int argc, char* args[], const char* name )
+{
+    for( int i = 0; i < argc; i++ )
+    {
+        if( strcmp( args[ i ], name ) == 0 )
+        {
+            return true;
+        }
+    }
+    return false;
+}
 
-	//Return success
-	mTexture = newTexture;
-	return mTexture != NULL;
+uint64_t stateHash( const Game& game )
+{
+    GameState state;
+    game.capture( state );
+    return hashBytes( &state, sizeof( state ) );
 }
 
-void LTexture::free()
+uint64_t hashBytes( const void* data, size_t size )
 {
-	//Free texture if it exists
-	if( mTexture != NULL )
-	{
-		SDL_DestroyTexture( mTexture );
-		mTexture = NULL;
-		mWidth = 0;
-		mHeight = 0;
-	}
+    const uint8_t* bytes = (const uint8_t*)data;
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for( size_t i = 0; i < size; i++ )
+    {
+        hash = ( hash ^ bytes[ i ] ) * 0x100000001b3ULL;
+    }
+    return hash;
 }
 
-void LTexture::render( int x, int y, SDL_Rect* clip )
+bool saveFramePNG( std::string path, const uint32_t* pixels )
 {
-	//Set rendering space and render to screen
-	SDL_Rect renderQuad = { x, y, mWidth, mHeight };
+    SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormatFrom( (void*)pixels, SCREEN_WIDTH, SCREEN_HEIGHT, 32, SCREEN_WIDTH * 4,
+                                                               SDL_PIXELFORMAT_ARGB8888 );
+    bool saved = surface != NULL && IMG_SavePNG( surface, path.c_str() ) == 0;
+    if( !saved )
+    {
+        printf( "Unable to write %s! SDL Error: %s\n", path.c_str(), SDL_GetError() );
+    }
+    SDL_FreeSurface( surface );
+    return saved;
+}
 
-	//Set clip rendering dimensions
-	if( clip != NULL )
-	{
-		renderQuad.w = clip->w;
-		renderQuad.h = clip->h;
-	}
+int runReplay( int argc, char* args[] )
+{
+    const char* path = args[ 0 ];
+    ReplayFile replay;
+    if( !replay.open( path ) )
+    {
+        return 1;
+    }
 
-	//Render to screen
-	SDL_RenderCopy( gRenderer, mTexture, clip, &renderQuad );
+    //jump straight to a tick through the keyframe index next to the replay
+    const char* seekOption = stringOption( argc, args, "--seek" );
+    if( seekOption != NULL )
+    {
+        int tick = atoi( seekOption );
+        KeyframeIndex index;
+        if( !index.openOrBuild( std::string( path ) + ".idx", replay ) )
+        {
+            return 1;
+        }
+
+        Game game( replay.getHeader().ghostAI );
+        Uint64 start = SDL_GetPerformanceCounter();
+        bool reached = index.seek( replay, game, tick );
+        double seconds = (double)( SDL_GetPerformanceCounter() - start ) / SDL_GetPerformanceFrequency();
+
+        printf( "%s: %s tick %d in %.3f ms, %d pellets left, state %016llx\n", path, reached ? "at" : "game ended before",
+                reached ? tick : game.getFrame(), seconds * 1000, game.getBoard().pelletsLeft(), (unsigned long long)stateHash( game ) );
+        return reached ? 0 : 1;
+    }
+
+    //recordings cut off before their end marker play on until the player dies
+    int endTick = replay.getEndTick();
+    int maxFrames = endTick >= 0 ? endTick : 60 * 60 * 30;
+    const char* framesOption = stringOption( argc, args, "--frames" );
+    if( framesOption != NULL )
+    {
+        maxFrames = std::min( maxFrames, atoi( framesOption ) );
+    }
+
+    Game game( replay.getHeader().ghostAI );
+    bool running = true;
+    Uint64 start = SDL_GetPerformanceCounter();
+    while( running && game.getFrame() < maxFrames )
+    {
+        int turn = replay.turnAt( game.getFrame() );
+        if( turn != DEFAULT )
+        {
+            game.steer( turn );
+        }
+        running = game.step();
+    }
+    double seconds = (double)( SDL_GetPerformanceCounter() - start ) / SDL_GetPerformanceFrequency();
+
+    printf( "%s: %s after %d frames, %d pellets left, state %016llx (%.0f frames/s)\n", path, running ? "stopped" : "died",
+            game.getFrame(), game.getBoard().pelletsLeft(), (unsigned long long)stateHash( game ), game.getFrame() / seconds );
+
+    return 0;
 }
 
-int LTexture::getWidth()
+int runExport( int argc, char* args[] )
 {
-	return mWidth;
+    if( argc < 1 || args[ 0 ][ 0 ] == '-' )
+    {
+        printf( "usage: pacman --export OUT.y4m|OUT%%05d.png [--replay FILE] [--seed S] [--frames F] [--ai arcade|path]\n" );
+        return 1;
+    }
+    const char* path = args[ 0 ];
+
+    //turns come from a replay when one is given, from the seeded random bot otherwise
+    ReplayFile replay;
+    const char* replayPath = stringOption( argc, args, "--replay" );
+    if( replayPath != NULL && !replay.open( replayPath ) )
+    {
+        return 1;
+    }
+    int ai = replayPath != NULL ? replay.getHeader().ghostAI : ghostAIOption( argc, args );
+    if( ai < 0 )
+    {
+        return 1;
+    }
+    const char* seedOption = stringOption( argc, args, "--seed" );
+    uint32_t bot = gameSeed( seedOption != NULL ? (uint32_t)strtoul( seedOption, NULL, 10 ) : 1, 0 );
+
+    //a replay runs to where its recording stopped, a bot game to its death or five minutes
+    int maxFrames = replayPath != NULL && replay.getEndTick() >= 0 ? replay.getEndTick() : 60 * 60 * 5;
+    const char* framesOption = stringOption( argc, args, "--frames" );
+    if( framesOption != NULL )
+    {
+        maxFrames = std::min( maxFrames, atoi( framesOption ) );
+    }
+
+    //frames are composed on the CPU, SDL's software renderer is only there to load the sprites
+    SDL_Surface* surface;
+    if( !startOffscreen( surface ) )
+    {
+        printf( "Unable to load sprites, pacman.png is needed in the working directory!\n" );
+        return 1;
+    }
+    VideoWriter video;
+    if( !gSoftRenderer.create( "pacman.png" ) || !video.open( path, TICKS_PER_SECOND ) )
+    {
+        gSoftRenderer.free();
+        stopOffscreen( surface );
+        return 1;
+    }
+
+    //one video frame per tick, drawn at the tick's own positions
+    Game game( ai );
+    EntityPositions previous;
+    bool running = true;
+    Uint64 start = SDL_GetPerformanceCounter();
+    while( running && game.getFrame() < maxFrames )
+    {
+        int turn = replayPath != NULL ? replay.turnAt( game.getFrame() ) : botAction( bot );
+        if( turn != DEFAULT )
+        {
+            game.steer( turn );
+        }
+        capturePositions( game, previous );
+        running = game.step();
+        renderGame( game, previous, 1.0f );
+        video.write( gSoftRenderer.getPixels() );
+    }
+    bool written = video.close();
+    double seconds = (double)( SDL_GetPerformanceCounter() - start ) / SDL_GetPerformanceFrequency();
+
+    printf( "%s: %d frames in %.2f s, %.0f frames/s (%.1fx real time), %ld waits on the disk%s\n", path, game.getFrame(), seconds,
+            game.getFrame() / seconds, game.getFrame() / seconds / TICKS_PER_SECOND, video.getStalls(), written ? "" : ", NOT ALL WRITTEN" );
+
+    gSoftRenderer.free();
+    stopOffscreen( surface );
+    return written ? 0 : 1;
 }
 
-int LTexture::getHeight()
+int runGolden( int argc, char* args[] )
 {
-	return mHeight;
-}
-
-Entity::Entity()
-{
-    mouthOpen = true;
-    fleeMode = false;
-    eaten = false;
-}
-
-Entity::~Entity()
-{
-    //Deallocate entity
-    free();
-}
-
-void Entity::free()
-{
-    xLoc = 0;
-    yLoc = 0;
-    orientation = 0;
-    mouthOpen = 0;
-}
-
-void Entity::update(Board b)
-{
-    //Changes mouth to open or closed, or the other way
-    setMouthOpen(!getMouthOpen());
-
-    //Moves entity coordinates based on direction of movement
-    //entity will traverse exactly one tile (8 pixels) at a time
-    //distances are offset by starting location
-    int xTile = (getXLoc() - 4) / 8;
-    int yTile = (getYLoc() - 4) / 8;
-
-    //removes eaten status at start tile
-    if (xTile == 13 && yTile == 11)
-    {
-        eaten = false;
-    }
-
-    for(int i = 0; i < 2; i++)
-    {
-        switch(getOrientation())
-        {
-        //max added for wraparound
-        case(RIGHT):
-        if (b.getTile(yTile, std::max(xTile, 0)).canGoRight() || ((getXLoc()- 15) % 8 != 0) || ((getYLoc() - 13) % 8 != 0))
-        {
-            setXLoc(getXLoc() + 1);
-        }
-        break;
-
-        //min added for wraparound
-        case(LEFT):
-        if (b.getTile(yTile, std::min(xTile, 27)).canGoLeft() || ((getXLoc() - 15) % 8 != 0) || ((getYLoc() - 13) % 8 != 0))
-        {
-            setXLoc(getXLoc() - 1);
-        }
-        break;
-
-        case(UP):
-        if (b.getTile(yTile, xTile).canGoUp() || ((getXLoc() - 15) % 8 != 0) || ((getYLoc() - 13) % 8 != 0))
-        {
-            setYLoc(getYLoc() - 1);
-        }
-        break;
-
-        case(DOWN):
-        if (b.getTile(yTile, xTile).canGoDown() || ((getXLoc() - 15) % 8 != 0) || ((getYLoc() - 13) % 8 != 0))
-        {
-            setYLoc(getYLoc() + 1);
-        }
-        break;
-
-        default:
-        break;
-        }
-    }
-
-    //wrap around
-    if (getXLoc() > 224)
-    {
-        setXLoc(-1);
-    }
-    else if (getXLoc() < 0)
-    {
-        setXLoc(221);
-    }
-
-    //reset theser variables
-    yTile = (getYLoc() - 4) / 8;
-    xTile = (getXLoc() - 4) / 8;
-
-    //change direction if you can
-    //direction will be changed as soon as entity is fully on a tile that can exit in that direction
-    if ((getXLoc() - 15) % 8 == 0 && (getYLoc() - 13) % 8 == 0)
-    {
-        switch(nextTurn)
-        {
-            case(UP):
-            if (b.getTile(yTile, xTile).canGoUp())
-            {
-                setOrientation(UP);
-            }
-            break;
-            case(DOWN):
-            if (b.getTile(yTile, xTile).canGoDown())
-            {
-                setOrientation(DOWN);
-            }
-            break;
-            case(LEFT):
-            if (b.getTile(yTile, xTile).canGoLeft())
-            {
-                setOrientation(LEFT);
-            }
-            break;
-            case(RIGHT):
-            if (b.getTile(yTile, xTile).canGoRight())
-            {
-                setOrientation(RIGHT);
-            }
-            break;
-            default:
-            break;
-        }
-    }
-}
-
-void Entity::setXLoc(int x)
-{
-    xLoc = x;
-}
-
-void Entity::setYLoc(int y)
-{
-    yLoc = y;
-}
-
-void Entity::setOrientation(int dir)
-{
-    orientation = dir;
-}
-
-int Entity::getXLoc()
-{
-    return xLoc;
-}
-
-int Entity::getYLoc()
-{
-    return yLoc;
-}
-
-int Entity::getOrientation()
-{
-    return orientation;
-}
-
-bool Entity::getMouthOpen()
-{
-    return mouthOpen;
-}
-
-void Entity::setMouthOpen(bool b)
-{
-    mouthOpen = b;
-}
-
-int Entity::currentSprite()
-{
-    return (getOrientation() * 2) + mouthOpen;
-}
-
-void Entity::setNextTurn(int turn)
-{
-    nextTurn = turn;
-}
-
-Blinky::Blinky()
-{
-    //spawns near ghost house
-    setXLoc(111);
-    setYLoc(93);
-    setOrientation(UP);
-}
-
-Pinky::Pinky()
-{
-    setXLoc(127);
-    setYLoc(93);
-    setOrientation(UP);
-}
-
-Inky::Inky()
-{
-    setXLoc(143);
-    setYLoc(93);
-    setOrientation(UP);
-}
-
-Clyde::Clyde()
-{
-    setXLoc(159);
-    setYLoc(93);
-    setOrientation(UP);
-}
-
-void Blinky::decideTurn(Board b, Player p)
-{
-    //finds distance between blinky and player
-    int yTile = (getYLoc() - 4) / 8;
-    int xTile = (getXLoc() - 4) / 8;
-    Tile currentTile = b.getTile(yTile, xTile);
-    int goalY;
-    int goalX;
-    if (getEaten())
-    {
-        goalY = 11;
-        goalX = 13;
-    }
-    else if (getScatter() && !getFlee())
-    {
-        goalY = 0;
-        goalX = 27;
-    }
-    else if (!getScatter() && !getEaten())
-    {
-        goalY = (p.getYLoc() - 4) / 8;
-        goalX = (p.getXLoc() - 4) / 8;
-    }
-
-    //blinky will always try to go towards the player but can only turn in 90 degree angles and only thinks one space ahead
-    int best = DEFAULT;
-    int worst = DEFAULT;
-    int bestHamilton = abs(goalY - yTile) + abs(goalX - xTile) + 5;
-    int worstHamilton = bestHamilton - 10;
-    int hypotheticalDistance;
-    if (currentTile.canGoDown() && getOrientation() != UP)
-    {
-        hypotheticalDistance = abs(goalY - (yTile + 1)) + abs(goalX - xTile);
-        if (hypotheticalDistance < bestHamilton)
-        {
-            best = DOWN;
-            bestHamilton = hypotheticalDistance;
-        }
-        if (hypotheticalDistance > worstHamilton)
-        {
-            worst = DOWN;
-            worstHamilton = hypotheticalDistance;
-        }
-    }
-    if (currentTile.canGoUp() && getOrientation() != DOWN)
-    {
-        hypotheticalDistance = abs(goalY - (yTile - 1)) + abs(goalX - xTile);
-        if (hypotheticalDistance < bestHamilton)
-        {
-            best = UP;
-            bestHamilton = hypotheticalDistance;
-        }
-        if (hypotheticalDistance > worstHamilton)
-        {
-            worst = UP;
-            worstHamilton = hypotheticalDistance;
-        }
-    }
-    if (currentTile.canGoLeft() && getOrientation() != RIGHT)
-    {
-        hypotheticalDistance = abs(goalY - yTile) + abs(goalX - (xTile - 1));
-        if (hypotheticalDistance < bestHamilton)
-        {
-            best = LEFT;
-            bestHamilton = hypotheticalDistance;
-        }
-        if (hypotheticalDistance > worstHamilton)
-        {
-            worst = LEFT;
-            worstHamilton = hypotheticalDistance;
-        }
-    }
-    if (currentTile.canGoRight() && getOrientation() != LEFT)
-    {
-        hypotheticalDistance = abs(goalY - yTile) + abs(goalX - (xTile + 1));
-        if (hypotheticalDistance < bestHamilton)
-        {
-            best = RIGHT;
-            bestHamilton = hypotheticalDistance;
-        }
-        if (hypotheticalDistance > worstHamilton)
-        {
-            worst = RIGHT;
-            worstHamilton = hypotheticalDistance;
-        }
-    }
-    if (getFlee() && !getEaten())
-    {
-        setNextTurn(worst);
-    }
-    else
-    {
-        setNextTurn(best);
-    }
-}
-
-void Pinky::decideTurn(Board b, Player p)
-{
-    //finds distance between pinky and goal (front of players mouth)
-    int yTile = (getYLoc() - 4) / 8;
-    int xTile = (getXLoc() - 4) / 8;
-    Tile currentTile = b.getTile(yTile, xTile);
-    int goalX;
-    int goalY;
-    if (getEaten())
-    {
-        goalY = 11;
-        goalX = 13;
-    }
-    else if (getScatter() && !getFlee())
-    {
-        goalY = 0;
-        goalX = 0;
-    }
-    else
-    {
-        goalY = (p.getYLoc() - 4) / 8;
-        goalX = (p.getXLoc() - 4) / 8;
-
-        switch(p.getOrientation())
-        {
-            case LEFT:
-                goalX -= 4;
-                break;
-            case RIGHT:
-                goalX += 4;
-                break;
-            case UP:
-                goalY -= 4;
-                break;
-            case DOWN:
-                goalY += 4;
-                break;
-            default:
-                break;
-        }
-    }
-
-    //pinky will always try to go towards the goal but can only turn in 90 degree angles and only thinks one space ahead
-    int best = DEFAULT;
-    int worst = DEFAULT;
-    int bestHamilton = abs(goalY - yTile) + abs(goalX - xTile) + 5;
-    int worstHamilton = bestHamilton - 10;
-    int hypotheticalDistance;
-    if (currentTile.canGoDown() && getOrientation() != UP)
-    {
-        hypotheticalDistance = abs(goalY - (yTile + 1)) + abs(goalX - xTile);
-        if (hypotheticalDistance < bestHamilton)
-        {
-            best = DOWN;
-            bestHamilton = hypotheticalDistance;
-        }
-        if (hypotheticalDistance > worstHamilton)
-        {
-            worst = DOWN;
-            worstHamilton = hypotheticalDistance;
-        }
-    }
-    if (currentTile.canGoUp() && getOrientation() != DOWN)
-    {
-        hypotheticalDistance = abs(goalY - (yTile - 1)) + abs(goalX - xTile);
-        if (hypotheticalDistance < bestHamilton)
-        {
-            best = UP;
-            bestHamilton = hypotheticalDistance;
-        }
-        if (hypotheticalDistance > worstHamilton)
-        {
-            worst = UP;
-            worstHamilton = hypotheticalDistance;
-        }
-    }
-    if (currentTile.canGoLeft() && getOrientation() != RIGHT)
-    {
-        hypotheticalDistance = abs(goalY - yTile) + abs(goalX - (xTile - 1));
-        if (hypotheticalDistance < bestHamilton)
-        {
-            best = LEFT;
-            bestHamilton = hypotheticalDistance;
-        }
-        if (hypotheticalDistance > worstHamilton)
-        {
-            worst = LEFT;
-            worstHamilton = hypotheticalDistance;
-        }
-    }
-    if (currentTile.canGoRight() && getOrientation() != LEFT)
-    {
-        hypotheticalDistance = abs(goalY - yTile) + abs(goalX - (xTile + 1));
-        if (hypotheticalDistance < bestHamilton)
-        {
-            best = RIGHT;
-            bestHamilton = hypotheticalDistance;
-        }
-        if (hypotheticalDistance > worstHamilton)
-        {
-            worst = RIGHT;
-            worstHamilton = hypotheticalDistance;
-        }
-    }
-    if (getFlee() && !getEaten())
-    {
-        setNextTurn(worst);
-    }
-    else
-    {
-        setNextTurn(best);
-    }
-}
-
-void Inky::decideTurn(Board b, Player p, Blinky blink)
-{
-    //finds distance between inky and goal
-    int yTile = (getYLoc() - 4) / 8;
-    int xTile = (getXLoc() - 4) / 8;
-    Tile currentTile = b.getTile(yTile, xTile);
-    int goalX;
-    int goalY;
-    if (getEaten())
-    {
-        goalY = 11;
-        goalX = 13;
-    }
-    else if (getScatter() && !getFlee())
-    {
-        goalX = 0;
-        goalY = 30;
-    }
-    else
-    {
-        goalY = (p.getYLoc() - 4) / 8;
-        goalX = (p.getXLoc() - 4) / 8;
-        int blinkyX = blink.getXLoc();
-        int blinkyY = blink.getYLoc();
-
-        switch(p.getOrientation())
-        {
-            case LEFT:
-                goalX -= 2;
-                break;
-            case RIGHT:
-                goalX += 2;
-                break;
-            case UP:
-                goalY -= 2;
-                break;
-            case DOWN:
-                goalY += 2;
-                break;
-            default:
-                break;
-        }
-
-        goalX += (goalX - blinkyX);
-        goalY += (goalY - blinkyY);
-    }
-
-    //inky will always try to go towards the goal but can only turn in 90 degree angles and only thinks one space ahead
-    int best = DEFAULT;
-    int worst = DEFAULT;
-    int bestHamilton = abs(goalY - yTile) + abs(goalX - xTile) + 5;
-    int worstHamilton = bestHamilton - 10;
-    int hypotheticalDistance;
-    if (currentTile.canGoDown() && getOrientation() != UP)
-    {
-        hypotheticalDistance = abs(goalY - (yTile + 1)) + abs(goalX - xTile);
-        if (hypotheticalDistance < bestHamilton)
-        {
-            best = DOWN;
-            bestHamilton = hypotheticalDistance;
-        }
-        if (hypotheticalDistance > worstHamilton)
-        {
-            worst = DOWN;
-            worstHamilton = hypotheticalDistance;
-        }
-    }
-    if (currentTile.canGoUp() && getOrientation() != DOWN)
-    {
-        hypotheticalDistance = abs(goalY - (yTile - 1)) + abs(goalX - xTile);
-        if (hypotheticalDistance < bestHamilton)
-        {
-            best = UP;
-            bestHamilton = hypotheticalDistance;
-        }
-        if (hypotheticalDistance > worstHamilton)
-        {
-            worst = UP;
-            worstHamilton = hypotheticalDistance;
-        }
-    }
-    if (currentTile.canGoLeft() && getOrientation() != RIGHT)
-    {
-        hypotheticalDistance = abs(goalY - yTile) + abs(goalX - (xTile - 1));
-        if (hypotheticalDistance < bestHamilton)
-        {
-            best = LEFT;
-            bestHamilton = hypotheticalDistance;
-        }
-        if (hypotheticalDistance > worstHamilton)
-        {
-            worst = LEFT;
-            worstHamilton = hypotheticalDistance;
-        }
-    }
-    if (currentTile.canGoRight() && getOrientation() != LEFT)
-    {
-        hypotheticalDistance = abs(goalY - yTile) + abs(goalX - (xTile + 1));
-        if (hypotheticalDistance < bestHamilton)
-        {
-            best = RIGHT;
-            bestHamilton = hypotheticalDistance;
-        }
-        if (hypotheticalDistance > worstHamilton)
-        {
-            worst = RIGHT;
-            worstHamilton = hypotheticalDistance;
-        }
-    }
-    if (getFlee() && !getEaten())
-    {
-        setNextTurn(worst);
-    }
-    else
-    {
-        setNextTurn(best);
-    }
-}
-
-Board::Board()
-{
-    //create initial tiles
-    //this was BY FAR the most tedious part
-    for (int i = 0; i < 31; i++)
-    {
-        for (int j = 0; j < 28; j++)
-        {
-            tiles[i][j] = Tile();
-        }
-    }
-
-    //add in barriers
-    for (int i = 1; i < 27; i++)
-    {
-        if (i != 14 && i != 13)
-        {
-            tiles[1][i].setGoRight(true);
-            tiles[1][i].setGoLeft(true);
-            tiles[20][i].setGoLeft(true);
-            tiles[20][i].setGoRight(true);
-        }
-
-    }
-    tiles[1][12].setGoRight(false);
-    tiles[1][15].setGoLeft(false);
-    tiles[1][1].setGoLeft(false);
-    tiles[1][26].setGoRight(false);
-    tiles[20][12].setGoRight(false);
-    tiles[20][15].setGoLeft(false);
-    tiles[20][1].setGoLeft(false);
-    tiles[20][26].setGoRight(false);
-
-    for (int i = 1; i < 27; i++)
-    {
-        if (i != 1)
-        {
-            tiles[5][i].setGoLeft(true);
-        }
-        if (i != 26)
-        {
-            tiles[5][i].setGoRight(true);
-        }
-    }
-
-    for (int i = 1; i < 9; i++)
-    {
-        if (i != 1)
-        {
-            tiles[i][1].setGoUp(true);
-            tiles[i][26].setGoUp(true);
-        }
-        if (i != 8)
-        {
-            tiles[i][1].setGoDown(true);
-            tiles[i][26].setGoDown(true);
-        }
-    }
-
-    for (int i = 1; i < 7; i++)
-    {
-        if (i != 1)
-        {
-            tiles[8][i].setGoLeft(true);
-            tiles[26][i].setGoLeft(true);
-        }
-        if (i != 6)
-        {
-            tiles[8][i].setGoRight(true);
-            tiles[26][i].setGoRight(true);
-        }
-    }
-
-    tiles[8][9].setGoRight(true);
-    tiles[8][10].setGoRight(true);
-    tiles[8][11].setGoRight(true);
-    tiles[8][10].setGoLeft(true);
-    tiles[8][11].setGoLeft(true);
-    tiles[8][12].setGoLeft(true);
-
-    tiles[8][15].setGoRight(true);
-    tiles[8][16].setGoRight(true);
-    tiles[8][17].setGoRight(true);
-    tiles[8][16].setGoLeft(true);
-    tiles[8][17].setGoLeft(true);
-    tiles[8][18].setGoLeft(true);
-
-    tiles[26][9].setGoRight(true);
-    tiles[26][10].setGoRight(true);
-    tiles[26][11].setGoRight(true);
-    tiles[26][10].setGoLeft(true);
-    tiles[26][11].setGoLeft(true);
-    tiles[26][12].setGoLeft(true);
-
-    tiles[26][15].setGoRight(true);
-    tiles[26][16].setGoRight(true);
-    tiles[26][17].setGoRight(true);
-    tiles[26][16].setGoLeft(true);
-    tiles[26][17].setGoLeft(true);
-    tiles[26][18].setGoLeft(true);
-
-    for (int i = 21; i < 27; i++)
-    {
-        if (i != 21)
-        {
-            tiles[8][i].setGoLeft(true);
-        }
-        if (i != 26)
-        {
-            tiles[8][i].setGoRight(true);
-        }
-    }
-
-    for (int i = 1; i < 27; i++) {
-        if (i != 1)
-        {
-            tiles[i][6].setGoUp(true);
-            tiles[i][21].setGoUp(true);
-            tiles[29][i].setGoLeft(true);
-        }
-        if (i != 26)
-        {
-            tiles[i][6].setGoDown(true);
-            tiles[i][21].setGoDown(true);
-            tiles[29][i].setGoRight(true);
-        }
-    }
-
-    for (int i = 0; i < 10; i++)
-    {
-        tiles[14][i].setGoLeft(true);
-        if (i != 9)
-        {
-            tiles[14][i].setGoRight(true);
-        }
-    }
-
-    for (int i = 18; i < 28; i++)
-    {
-        tiles[14][i].setGoRight(true);
-        if (i != 18)
-        {
-            tiles[14][i].setGoLeft(true);
-        }
-    }
-
-    for (int i = 9; i < 19; i++)
-    {
-        if (i != 9)
-        {
-            tiles[11][i].setGoLeft(true);
-            tiles[17][i].setGoLeft(true);
-        }
-        if (i != 18)
-        {
-            tiles[11][i].setGoRight(true);
-            tiles[17][i].setGoRight(true);
-        }
-    }
-
-    for (int i = 11; i < 21; i++)
-    {
-        if (i != 11)
-        {
-            tiles[i][9].setGoUp(true);
-            tiles[i][18].setGoUp(true);
-        }
-        if (i != 20)
-        {
-            tiles[i][9].setGoDown(true);
-            tiles[i][18].setGoDown(true);
-        }
-    }
-
-    for (int i = 1; i < 6; i++)
-    {
-        if (i != 1)
-        {
-            tiles[i][12].setGoUp(true);
-            tiles[i][15].setGoUp(true);
-        }
-        if (i != 5)
-        {
-            tiles[i][12].setGoDown(true);
-            tiles[i][15].setGoDown(true);
-        }
-    }
-
-    for (int i = 5; i < 9; i++)
-    {
-        if (i != 5)
-        {
-            tiles[i][9].setGoUp(true);
-            tiles[i][18].setGoUp(true);
-        }
-        if (i != 8)
-        {
-            tiles[i][9].setGoDown(true);
-            tiles[i][18].setGoDown(true);
-        }
-    }
-
-    for (int i = 8; i < 12; i++)
-    {
-        if (i != 8)
-        {
-            tiles[i][12].setGoUp(true);
-            tiles[i][15].setGoUp(true);
-        }
-        if (i != 11)
-        {
-            tiles[i][12].setGoDown(true);
-            tiles[i][15].setGoDown(true);
-        }
-    }
-
-    for (int i = 20; i < 24; i++)
-    {
-        if (i != 20)
-        {
-            tiles[i][1].setGoUp(true);
-            tiles[i][12].setGoUp(true);
-            tiles[i][15].setGoUp(true);
-            tiles[i][26].setGoUp(true);
-        }
-        if (i != 23)
-        {
-            tiles[i][1].setGoDown(true);
-            tiles[i][12].setGoDown(true);
-            tiles[i][15].setGoDown(true);
-            tiles[i][26].setGoDown(true);
-        }
-    }
-
-    for (int i = 6; i < 22; i++) {
-        if (i != 6)
-        {
-            tiles[23][i].setGoLeft(true);
-        }
-        if (i != 21)
-        {
-            tiles[23][i].setGoRight(true);
-        }
-    }
-
-    for (int i = 23; i < 27; i++)
-    {
-        if (i != 23)
-        {
-            tiles[i][9].setGoUp(true);
-            tiles[i][18].setGoUp(true);
-            tiles[i][3].setGoUp(true);
-            tiles[i][24].setGoUp(true);
-        }
-        if (i != 26)
-        {
-            tiles[i][9].setGoDown(true);
-            tiles[i][18].setGoDown(true);
-            tiles[i][3].setGoDown(true);
-            tiles[i][24].setGoDown(true);
-        }
-    }
-
-    for (int i = 21; i < 27; i++)
-    {
-        if (i != 26)
-        {
-            tiles[26][i].setGoRight(true);
-        }
-        if (i != 21)
-        {
-            tiles[26][i].setGoLeft(true);
-        }
-    }
-
-    tiles[23][1].setGoRight(true);
-    tiles[23][2].setGoRight(true);
-    tiles[23][2].setGoLeft(true);
-    tiles[23][3].setGoLeft(true);
-
-    tiles[23][24].setGoRight(true);
-    tiles[23][25].setGoRight(true);
-    tiles[23][25].setGoLeft(true);
-    tiles[23][26].setGoLeft(true);
-
-    for (int i = 26; i < 30; i++)
-    {
-        if (i != 26)
-        {
-            tiles[i][1].setGoUp(true);
-            tiles[i][12].setGoUp(true);
-            tiles[i][15].setGoUp(true);
-            tiles[i][26].setGoUp(true);
-        }
-        if (i != 29)
-        {
-            tiles[i][1].setGoDown(true);
-            tiles[i][12].setGoDown(true);
-            tiles[i][15].setGoDown(true);
-            tiles[i][26].setGoDown(true);
-        }
-    }
-}
-
-void Board::updateBoard(Player p)
-{
-    //finds tile player is on
-    int xTile = p.getXLoc() / 8;
-    int yTile = p.getYLoc() / 8;
-
-    //crosses off that tile if it has not been
-    if (!tiles[yTile][xTile].getCrossed())
-    {
-        tiles[yTile][xTile].crossOff();
-    }
-}
-
-Tile Board::getTile(int i, int j)
-{
-    return tiles[i][j];
+    if( argc < 1 || args[ 0 ][ 0 ] == '-' )
+    {
+        printf( "usage: pacman --golden LIST [--update] [--renderer soft] [--ai arcade|path]\n" );
+        return 1;
+    }
+    const char* listPath = args[ 0 ];
+    bool update = flagOption( argc, args, "--update" );
+    const char* rendererOption = stringOption( argc, args, "--renderer" );
+    bool soft = rendererOption != NULL && strcmp( rendererOption, "soft" ) == 0;
+    int ai = ghostAIOption( argc, args );
+    if( ai < 0 )
+    {
+        return 1;
+    }
+
+    //"<script> <tick> <hash>" a line, the hash can be left off for --update to fill in, other lines are kept as they are
+    //scripts are found relative to the list, so a checked in list runs from anywhere
+    struct Check
+    {
+        size_t line;
+
+        //script as written in the list, and where it is found from here
+        std::string name;
+        std::string script;
+        int tick;
+        uint64_t hash;
+        bool known;
+    };
+    FILE* file = fopen( listPath, "r" );
+    if( file == NULL )
+    {
+        printf( "Unable to open golden list %s!\n", listPath );
+        return 1;
+    }
+    std::string directory = listPath;
+    directory.erase( directory.find_last_of( '/' ) + 1 );
+    std::vector<std::string> lines;
+    std::vector<Check> checks;
+    std::vector<std::string> scripts;
+    char text[ 1024 ];
+    while( fgets( text, sizeof( text ), file ) != NULL )
+    {
+        text[ strcspn( text, "\r\n" ) ] = '\0';
+        lines.push_back( text );
+
+        char script[ 512 ];
+        unsigned long long hash;
+        Check check;
+        int fields = text[ 0 ] == '#' ? 0 : sscanf( text, "%511s %d %llx", script, &check.tick, &hash );
+        if( fields >= 2 )
+        {
+            check.line = lines.size() - 1;
+            check.name = script;
+            check.script = script[ 0 ] == '/' ? check.name : directory + check.name;
+            check.hash = fields == 3 ? hash : 0;
+            check.known = fields == 3;
+            checks.push_back( check );
+            if( std::find( scripts.begin(), scripts.end(), check.script ) == scripts.end() )
+            {
+                scripts.push_back( check.script );
+            }
+        }
+    }
+    fclose( file );
+
+    //frames are drawn the way the window draws them, into an offscreen surface
+    SDL_Surface* surface;
+    if( !startOffscreen( surface ) )
+    {
+        printf( "Unable to load sprites, pacman.png is needed in the working directory!\n" );
+        return 1;
+    }
+    if( soft && !gSoftRenderer.create( "pacman.png" ) )
+    {
+        stopOffscreen( surface );
+        return 1;
+    }
+
+    std::vector<uint32_t> pixels( (size_t)SCREEN_WIDTH * SCREEN_HEIGHT );
+    int failures = 0;
+    long rendered = 0;
+    long ticks = 0;
+    Uint64 start = SDL_GetPerformanceCounter();
+    for( size_t s = 0; s < scripts.size(); s++ )
+    {
+        InputScript input;
+        bool loaded = input.loadFromFile( scripts[ s ] );
+        int last = 0;
+        for( size_t c = 0; c < checks.size(); c++ )
+        {
+            if( checks[ c ].script == scripts[ s ] )
+            {
+                last = std::max( last, checks[ c ].tick );
+            }
+        }
+
+        //play the script, stopping on every tick that has a check
+        Game game( ai );
+        bool running = loaded;
+        while( loaded )
+        {
+            bool drawn = false;
+            uint64_t hash = 0;
+            for( size_t c = 0; c < checks.size(); c++ )
+            {
+                Check& check = checks[ c ];
+                if( check.script != scripts[ s ] || check.tick != game.getFrame() )
+                {
+                    continue;
+                }
+
+                if( !drawn )
+                {
+                    EntityPositions positions;
+                    capturePositions( game, positions );
+                    SDL_SetRenderDrawColor( gRenderer, 0, 0, 0, 255 );
+                    SDL_RenderClear( gRenderer );
+                    renderGame( game, positions, 1.0f );
+                    if( soft )
+                    {
+                        memcpy( &pixels[ 0 ], gSoftRenderer.getPixels(), pixels.size() * sizeof( uint32_t ) );
+                    }
+                    else
+                    {
+                        SDL_RenderReadPixels( gRenderer, NULL, SDL_PIXELFORMAT_ARGB8888, &pixels[ 0 ], SCREEN_WIDTH * 4 );
+                    }
+                    hash = hashBytes( &pixels[ 0 ], pixels.size() * sizeof( uint32_t ) );
+                    drawn = true;
+                    rendered++;
+                }
+
+                if( update )
+                {
+                    check.hash = hash;
+                    check.known = true;
+                }
+                else if( !check.known || check.hash != hash )
+                {
+                    //the frame as it is now, to compare against what it should look like
+                    char name[ 600 ];
+                    snprintf( name, sizeof( name ), "%s.%d.png", check.script.c_str(), check.tick );
+                    saveFramePNG( name, &pixels[ 0 ] );
+                    printf( "FAIL %s tick %d: expected %016llx, got %016llx, wrote %s\n", check.script.c_str(), check.tick,
+                            (unsigned long long)check.hash, (unsigned long long)hash, name );
+                    failures++;
+                }
+            }
+            if( !running || game.getFrame() >= last )
+            {
+                break;
+            }
+
+            int turn = input.turnAt( game.getFrame() );
+            if( turn != DEFAULT )
+            {
+                game.steer( turn );
+            }
+            running = game.step();
+            ticks++;
+        }
+
+        //ticks the game never got to
+        for( size_t c = 0; c < checks.size(); c++ )
+        {
+            if( checks[ c ].script == scripts[ s ] && ( !loaded || checks[ c ].tick > game.getFrame() ) )
+            {
+                printf( "FAIL %s tick %d: %s\n", checks[ c ].script.c_str(), checks[ c ].tick,
+                        loaded ? "game ended before it" : "script not loaded" );
+                failures++;
+            }
+        }
+    }
+    double seconds = (double)( SDL_GetPerformanceCounter() - start ) / SDL_GetPerformanceFrequency();
+
+    gSoftRenderer.free();
+    stopOffscreen( surface );
+
+    if( update )
+    {
+        for( size_t c = 0; c < checks.size(); c++ )
+        {
+            if( !checks[ c ].known )
+            {
+                continue;
+            }
+            snprintf( text, sizeof( text ), "%s %d %016llx", checks[ c ].name.c_str(), checks[ c ].tick,
+                      (unsigned long long)checks[ c ].hash );
+            lines[ checks[ c ].line ] = text;
+        }
+        file = fopen( listPath, "w" );
+        if( file == NULL )
+        {
+            printf( "Unable to write golden list %s!\n", listPath );
+            return 1;
+        }
+        for( size_t i = 0; i < lines.size(); i++ )
+        {
+            fprintf( file, "%s\n", lines[ i ].c_str() );
+        }
+        fclose( file );
+    }
+
+    printf( "%s: %d frames %s, %d failed, %ld ticks in %.3f s (%.0f frames/s)\n", listPath, (int)checks.size(),
+            update ? "updated" : "checked", failures, ticks, seconds, rendered / seconds );
+    return failures ? 1 : 0;
 }
 
-bool init()
+int runHeadless( int argc, char* args[] )
 {
-	//Initialization flag
-	bool success = true;
+    //games that never end are cut off after 30 minutes of play
+    int maxFrames = 60 * 60 * 30;
+    std::vector<std::string> scripts;
+    for( int i = 0; i < argc; i++ )
+    {
+        if( strcmp( args[ i ], "--frames" ) == 0 && i + 1 < argc )
+        {
+            maxFrames = atoi( args[ ++i ] );
+        }
+        else if( strcmp( args[ i ], "--ai" ) == 0 && i + 1 < argc )
+        {
+            i++;
+        }
+        else
+        {
+            scripts.push_back( args[ i ] );
+        }
+    }
+    if( scripts.empty() )
+    {
+        printf( "usage: pacman --headless [--frames N] [--ai arcade|path] script...\n" );
+        return 1;
+    }
+    int ai = ghostAIOption( argc, args );
+    if( ai < 0 )
+    {
+        return 1;
+    }
 
-	//Initialize SDL
-	if( SDL_Init( SDL_INIT_VIDEO ) < 0 )
-	{
-		printf( "SDL could not initialize! SDL Error: %s\n", SDL_GetError() );
-		success = false;
-	}
-	else
-	{
-		//Set texture filtering to linear
-		if( !SDL_SetHint( SDL_HINT_RENDER_SCALE_QUALITY, "1" ) )
-		{
-			printf( "Warning: Linear texture filtering not enabled!" );
-		}
+    std::vector<InputScript> inputs( scripts.size() );
+    for( size_t i = 0; i < scripts.size(); i++ )
+    {
+        if( !inputs[ i ].loadFromFile( scripts[ i ] ) )
+        {
+            return 1;
+        }
+    }
 
-		//Create window
-		gWindow = SDL_CreateWindow( "Pac-Man", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, SCREEN_WIDTH, SCREEN_HEIGHT, SDL_WINDOW_SHOWN );
-		if( gWindow == NULL )
-		{
-			printf( "Window could not be created! SDL Error: %s\n", SDL_GetError() );
-			success = false;
-		}
-		else
-		{
-			//Create renderer for window
-			gRenderer = SDL_CreateRenderer( gWindow, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC );
-			if( gRenderer == NULL )
-			{
-				printf( "Renderer could not be created! SDL Error: %s\n", SDL_GetError() );
-				success = false;
-			}
-			else
-			{
-				//Initialize renderer color
-				SDL_SetRenderDrawColor( gRenderer, 0, 0, 0, 0 );
+    //every script plays in the same batch, in lockstep
+    long totalFrames = 0;
+    Uint64 start = SDL_GetPerformanceCounter();
+    BatchEnv env( (int)scripts.size(), ai, false );
+    std::vector<int> actions( scripts.size() );
+    for( int frame = 0; frame < maxFrames && env.running(); frame++ )
+    {
+        for( size_t i = 0; i < scripts.size(); i++ )
+        {
+            actions[ i ] = inputs[ i ].turnAt( frame );
+        }
+        env.step( actions.data() );
+    }
+    for( size_t i = 0; i < scripts.size(); i++ )
+    {
+        const Game& game = env.getGame( (int)i );
+        totalFrames += game.getFrame();
 
-				//Initialize PNG loading
-				int imgFlags = IMG_INIT_PNG;
-				if( !( IMG_Init( imgFlags ) & imgFlags ) )
-				{
-					printf( "SDL_image could not initialize! SDL_mage Error: %s\n", IMG_GetError() );
-					success = false;
-				}
-			}
-		}
-	}
+        printf( "%s: %s after %d frames, %d pellets left\n", scripts[ i ].c_str(), env.getDone()[ i ] ? "died" : "timed out",
+                game.getFrame(), game.getBoard().pelletsLeft() );
+    }
+    double seconds = (double)( SDL_GetPerformanceCounter() - start ) / SDL_GetPerformanceFrequency();
+    printf( "%d games, %ld frames in %.3f s (%.0f games/s, %.0f frames/s)\n", (int)scripts.size(), totalFrames, seconds,
+            scripts.size() / seconds, totalFrames / seconds );
 
-	return success;
-}
-
-int abs(int n)
-{
-    return n > 0 ? n : -n;
+    return 0;
 }
 
-bool loadMedia()
+int main( int argc, char* args[] )
 {
-	//Loading success flag
-	bool success = true;
+	//Run benchmarks without a window
+	if( argc > 1 && strcmp( args[ 1 ], "--bench" ) == 0 )
+	{
+		return runBenchmarks( argc - 2, args + 2 );
+	}
 
-	//Load sprite sheet texture
-	if( !gSpriteSheetTexture.loadFromFile( "pacman.png" ) )
+	//Run scripted games without a window
+	if( argc > 1 && strcmp( args[ 1 ], "--headless" ) == 0 )
 	{
-		printf( "Failed to load sprite sheet texture!\n" );
-		success = false;
+		return runHeadless( argc - 2, args + 2 );
 	}
-	else
+
+	//Run bot games across all cores without a window
+	if( argc > 1 && strcmp( args[ 1 ], "--batch" ) == 0 )
 	{
-		//Set board sprite
-		gBoard.x =   0;
-		gBoard.y =   0;
-		gBoard.w = 224;
-		gBoard.h = 248;
-
-		//Set player sprites
-		for (int i = 0; i < 4; i++)
-        {
-            for (int j = 0; j < 2; j++)
-            {
-                int index = (2 * i) + j;
-                gPlayer[index].x = 456 + (16 * j);
-                gPlayer[index].y = (16 * i);
-                gPlayer[index].w = 16;
-                gPlayer[index].h = 16;
-            }
-		}
-
-		//Split up board into tiles
-		for (int i = 0; i < 31; i++)
-        {
-            for (int j = 0; j < 28; j++)
-            {
-                gBoardPieces[i][j].y = i * 8;
-                gBoardPieces[i][j].x = j * 8;
-                gBoardPieces[i][j].w = 8;
-                gBoardPieces[i][j].h = 8;
-            }
-        }
-
-        //Do the same for alternate board
-        for (int i = 0; i < 31; i++)
-        {
-            for (int j = 0; j < 28; j++)
-            {
-                gBoardPiecesAlt[i][j].y = i * 8;
-                gBoardPiecesAlt[i][j].x = (j * 8) + 228;
-                gBoardPiecesAlt[i][j].w = 8;
-                gBoardPiecesAlt[i][j].h = 8;
-            }
-        }
-
-        //Set sprites for ghosts
-        for (int i = 0; i < 8; i++)
-        {
-            gBlinky[i].y = 64;
-            gBlinky[i].x = 456 + (16 * i);
-            gBlinky[i].w = 16;
-            gBlinky[i].h = 16;
-
-            gPinky[i].y = 80;
-            gPinky[i].x = 456 + (16 * i);
-            gPinky[i].w = 16;
-            gPinky[i].h = 16;
-
-            gInky[i].y = 96;
-            gInky[i].x = 456 + (16 * i);
-            gInky[i].w = 16;
-            gInky[i].h = 16;
-
-            gClyde[i].y = 112;
-            gClyde[i].x = 456 + (16 * i);
-            gClyde[i].w = 16;
-            gClyde[i].h = 16;
-        }
-
-        //set sprites for fleeing ghosts
-        for (int i = 0; i < 2; i++)
-        {
-            for (int j = 0; j < 4; j++)
-            {
-                int index = (4 * i) + j;
-                gMiscGhost[index].y = 64 + (16 * i);
-                gMiscGhost[index].x = 584 + (16 * j);
-                gMiscGhost[index].w = 16;
-                gMiscGhost[index].h = 16;
-            }
-        }
-
-        //set sprites for death sequence
-        for (int i = 0; i < 12; i++)
-        {
-            gPlayerDeath[i].y = 0;
-            gPlayerDeath[i].x = 488 + (16 * i);
-            gPlayerDeath[i].w = 16;
-            gPlayerDeath[i].h = 16;
-        }
+		return runBatch( argc - 2, args + 2 );
 	}
 
-	return success;
-}
+	//Play a recording back without a window
+	if( argc > 3 && strcmp( args[ 1 ], "--replay" ) == 0 && strcmp( args[ 3 ], "--headless" ) == 0 )
+	{
+		return runReplay( argc - 2, args + 2 );
+	}
 
-void close()
-{
-	//Free loaded images
-	gSpriteSheetTexture.free();
+	//Run a swarm of ghosts without a window
+	if( argc > 1 && strcmp( args[ 1 ], "--swarm" ) == 0 )
+	{
+		return runSwarm( argc - 2, args + 2 );
+	}
 
-	//Destroy window
-	SDL_DestroyRenderer( gRenderer );
-	SDL_DestroyWindow( gWindow );
-	gWindow = NULL;
-	gRenderer = NULL;
+	//Render a replay or bot game to video without a window
+	if( argc > 1 && strcmp( args[ 1 ], "--export" ) == 0 )
+	{
+		return runExport( argc - 2, args + 2 );
+	}
 
-	//Quit SDL subsystems
-	IMG_Quit();
-	SDL_Quit();
-}
+	//Check rendered frames against their golden hashes without a window
+	if( argc > 1 && strcmp( args[ 1 ], "--golden" ) == 0 )
+	{
+		return runGolden( argc - 2, args + 2 );
+	}
+
+	//Refuse a bad --ai before opening the window
+	if( ghostAIOption( argc, args ) < 0 )
+	{
+		return 1;
+	}
 
-int main( int argc, char* args[] )
-{
 	//Start up SDL and create window
 	if( !init() )
 	{
@@ -1513,256 +7586,362 @@ int main( int argc, char* args[] )
 		}
 		else
 		{
+			//"--renderer soft" composes frames on the CPU, SDL's renderer stays the default
+			const char* rendererOption = stringOption( argc, args, "--renderer" );
+			if( rendererOption != NULL && strcmp( rendererOption, "soft" ) == 0 && !gSoftRenderer.create( "pacman.png" ) )
+			{
+				printf( "Warning: Software framebuffer unavailable, using SDL's renderer!\n" );
+			}
+
+			//Load sound effects unless "--mute", the game plays on silently without a device or the WAVs
+			if( !flagOption( argc, args, "--mute" ) && gAudio.open() )
+			{
+				static const char* soundFiles[ SOUNDS ] = { "chomp.wav", "siren.wav", "energizer.wav", "eaten.wav", "death.wav" };
+				for( int i = 0; i < SOUNDS; i++ )
+				{
+					gAudio.load( i, soundFiles[ i ] );
+				}
+				gAudio.send( SOUND_SIREN, SOUND_LOOP );
+				gAudio.resume();
+			}
+
 			//Main loop flag
 			bool quit = false;
 
 			//Event handler
-			SDL_Event e;
-
-			//Current frame
-			int frame = 0;
-
-			//frame when fleeing starts
-			int fleeFrame = frame;
-
-			//create board
-			Board board;
-
-			//create player
-			Player player;
-
-			//create ghosts
-			Blinky blinky;
-			Pinky pinky;
-			Inky inky;
+			SDL_Event e;
+
+			//turns come from a recording instead of the keyboard when one is given
+			ReplayFile replay;
+			const char* replayPath = stringOption( argc, args, "--replay" );
+			if( replayPath != NULL && !replay.open( replayPath ) )
+			{
+				quit = true;
+			}
+			int ai = replayPath != NULL && !quit ? replay.getHeader().ghostAI : ghostAIOption( argc, args );
+			int endTick = replayPath != NULL && !quit ? replay.getEndTick() : -1;
+
+			//"--latency" times arrow presses to the turn and to the screen, "--latency-test N" makes N presses itself
+			const char* latencyTestOption = stringOption( argc, args, "--latency-test" );
+			int latencySamples = latencyTestOption != NULL ? std::max( atoi( latencyTestOption ), 1 ) : 0;
+			bool measureLatency = latencySamples > 0 || flagOption( argc, args, "--latency" );
+			LatencyTracker latency;
+
+			//create game, a batch of one that stops when the player dies, the latency test plays on through new games
+			BatchEnv env( 1, ai, latencySamples > 0 );
+			const Game& game = env.getGame( 0 );
+
+			//replays can start part way in, through the keyframe index next to them
+			const char* seekOption = stringOption( argc, args, "--seek" );
+			if( replayPath != NULL && !quit && seekOption != NULL )
+			{
+				KeyframeIndex index;
+				Game seeked( ai );
+				if( !index.openOrBuild( std::string( replayPath ) + ".idx", replay ) || !index.seek( replay, seeked, atoi( seekOption ) ) )
+				{
+					printf( "Unable to seek to tick %s!\n", seekOption );
+					quit = true;
+				}
+				else
+				{
+					GameState state;
+					seeked.capture( state );
+					env.restore( 0, state );
+					gBoardTexture.invalidate();
+				}
+			}
+
+			//turns taken are written out as they happen
+			ReplayWriter recorder;
+			const char* recordPath = stringOption( argc, args, "--record" );
+			if( recordPath != NULL && !recorder.open( recordPath, ai, 0 ) )
+			{
+				quit = true;
+			}
+
+			//turn to hand the game on its next step
+			int action = DEFAULT;
+
+			//last 30 seconds of play, stepped back through while backspace is held
+			//left off for recordings and replays, which only run forwards
+			RewindBuffer rewind;
+			bool rewinding = false;
+			bool canRewind = replayPath == NULL && recordPath == NULL;
+
+			//phase timings, F3 shows them, --trace and --profile-csv write them out on exit
+			gProfiler.setEnabled( true );
+			bool showProfile = false;
+			const char* tracePath = stringOption( argc, args, "--trace" );
+			const char* csvPath = stringOption( argc, args, "--profile-csv" );
+			gProfiler.setTracing( tracePath != NULL );
+			gProfiler.setLogging( csvPath != NULL );
+
+			//frame times and hitches, summarised on exit or on SIGUSR1
+			FrameMonitor monitor;
+			Uint64 lastFrameStart = 0;
+			int frameEvents = 0;
+#ifdef SIGUSR1
+			signal( SIGUSR1, requestSummary );
+#endif
+
+			//positions before the latest step, for drawing in between steps
+			EntityPositions previous;
+			capturePositions( game, previous );
+
+			//simulation runs in fixed steps, rendering runs as fast as the display refreshes
+			Uint64 frequency = SDL_GetPerformanceFrequency();
+			Uint64 tickLength = frequency / TICKS_PER_SECOND;
+			Uint64 frameLength = frequency / displayRefreshRate();
+			Uint64 lastTime = SDL_GetPerformanceCounter();
+			Uint64 accumulator = 0;
+
+			//"--threaded" steps the game on a thread of its own and draws the newest tick it finished
+			//SDL wants events and rendering on the thread that made the window, so those stay here and input is handed over
+			bool threaded = flagOption( argc, args, "--threaded" );
+			SimulationThread simulation( env, replayPath != NULL ? &replay : NULL, recorder, canRewind ? &rewind : NULL, endTick );
+			Game shown( ai );
+			Uint64 shownTime = lastTime;
+			if( threaded && !quit )
+			{
+				GameState state;
+				game.capture( state );
+				shown.restore( state );
+				simulation.start();
+			}
+
+			//the game being drawn, the simulation thread owns the real one while it runs
+			const Game& view = threaded ? shown : game;
+
+			//pellets left when sounds were last queued
+			int pellets = view.getBoard().pelletsLeft();
 
 			//While application is running
 			while( !quit )
 			{
+				//the frame scope covers the whole iteration, sleep included, so it lands in the next frame's totals
+				Uint64 frameStart = SDL_GetPerformanceCounter();
+				gProfiler.endFrame();
+				PROFILE_SCOPE( PROFILE_FRAME );
+
+				//the frame that just ended, from its start to this one's
+				if( lastFrameStart != 0 )
+				{
+					monitor.recordFrame( ( frameStart - lastFrameStart ) * 1000000 / frequency, frameLength * 1000000 / frequency,
+					                     view.getFrame(), frameEvents, gProfiler );
+				}
+				lastFrameStart = frameStart;
+				frameEvents = 0;
+				if( gSummaryRequested )
+				{
+					gSummaryRequested = 0;
+					monitor.printSummary();
+					fflush( stdout );
+				}
+
+				//the latency test presses keys through SDL's queue, and stops once it has its samples
+				if( latencySamples > 0 && !latency.inject( view, latencySamples ) )
+				{
+					quit = true;
+				}
+
 				//Handle events on queue
-				while( SDL_PollEvent( &e ) != 0 )
 				{
-					//User requests quit
-					if( e.type == SDL_QUIT )
+					PROFILE_SCOPE( PROFILE_EVENTS );
+					while( SDL_PollEvent( &e ) != 0 )
+					{
+						//User requests quit
+						if( e.type == SDL_QUIT )
+						{
+							quit = true;
+						}
+						//Target texture contents were lost
+						else if( e.type == SDL_RENDER_TARGETS_RESET )
+						{
+							gBoardTexture.invalidate();
+						}
+						//User lets go of rewind
+						else if( e.type == SDL_KEYUP && e.key.keysym.sym == SDLK_BACKSPACE )
+						{
+							rewinding = false;
+						}
+						//User presses a key
+						else if( e.type == SDL_KEYDOWN )
+                        {
+                            //arrow presses are timed from when SDL queued them, not from when we got round to them
+                            if( measureLatency && arrowDirection( e.key.keysym.sym ) != DEFAULT )
+                            {
+                                latency.press( arrowDirection( e.key.keysym.sym ), eventTime( e.key.timestamp ), view );
+                            }
+
+                            //Change player's direction to key press
+                            //make sure there is no wall in respective cases
+                            switch( e.key.keysym.sym )
+                            {
+                                case SDLK_RIGHT:
+                                action = RIGHT;
+                                break;
+
+                                case SDLK_LEFT:
+                                action = LEFT;
+                                break;
+
+                                case SDLK_UP:
+                                action = UP;
+                                break;
+
+                                case SDLK_DOWN:
+                                action = DOWN;
+                                break;
+
+                                case SDLK_BACKSPACE:
+                                rewinding = canRewind;
+                                break;
+
+                                //Toggle the profiler overlay, printing the numbers behind it
+                                case SDLK_F3:
+                                showProfile = !showProfile && gProfiler.isEnabled();
+                                if( gProfiler.isEnabled() )
+                                {
+                                    gProfiler.printStats();
+                                }
+                                break;
+
+                                default:
+                                break;
+                            }
+                        }
+					}
+				}
+				//Blend factor between the last two steps
+				float alpha;
+				if( threaded )
+				{
+					//hand the keys over and pick up whatever the simulation thread finished last
+					if( action != DEFAULT )
+					{
+						simulation.setAction( action );
+						action = DEFAULT;
+					}
+					simulation.setRewinding( rewinding );
+					if( simulation.update() )
+					{
+						const FrameSnapshot& snapshot = simulation.getSnapshot();
+						shown.restore( snapshot.state );
+						previous = snapshot.previous;
+						shownTime = snapshot.time;
+						if( measureLatency )
+						{
+							latency.update( shown, snapshot.time );
+						}
+					}
+					frameEvents |= simulation.takeEvents();
+					if( simulation.isFinished() )
 					{
 						quit = true;
-					}
-					//User presses a key
-					else if( e.type == SDL_KEYDOWN )
-                    {
-                        //Change player's direction to key press
-                        //make sure there is no wall in respective cases
-                        switch( e.key.keysym.sym )
-                        {
-                            case SDLK_RIGHT:
-                            player.setNextTurn(RIGHT);
-                            break;
-
-                            case SDLK_LEFT:
-                            player.setNextTurn(LEFT);
-                            break;
-
-                            case SDLK_UP:
-                            player.setNextTurn(UP);
-                            break;
-
-                            case SDLK_DOWN:
-                            player.setNextTurn(DOWN);
-                            break;
-
-                            default:
-                            break;
-                        }
-                    }
+					}
+					alpha = std::min( 1.0f, (float)( SDL_GetPerformanceCounter() - shownTime ) / tickLength );
+				}
+				else
+				{
+					//Bank the time since the last frame, but don't try to catch up after long stalls
+					Uint64 now = SDL_GetPerformanceCounter();
+					accumulator += now - lastTime;
+					lastTime = now;
+					if( accumulator > tickLength * TICKS_PER_SECOND / 4 )
+					{
+						accumulator = tickLength * TICKS_PER_SECOND / 4;
+					}
+
+					//Update game once for every tick that has passed
+					PROFILE_SCOPE( PROFILE_SIMULATION );
+					while( accumulator >= tickLength && !quit )
+					{
+						int tickEvents = 0;
+						if( !playTick( env, action, rewinding, replayPath != NULL ? &replay : NULL, recorder, canRewind ? &rewind : NULL,
+						               endTick, previous, tickEvents ) )
+						{
+							quit = true;
+						}
+						frameEvents |= tickEvents;
+						accumulator -= tickLength;
+						if( measureLatency )
+						{
+							latency.update( game, SDL_GetPerformanceCounter() );
+						}
+					}
+					alpha = (float)accumulator / tickLength;
+				}
+
+				//Queue sound effects for what the steps did
+				if( gAudio.isOpen() )
+				{
+					playSounds( view, frameEvents, pellets );
 				}
+
 				//Clear screen
 				SDL_SetRenderDrawColor( gRenderer, 0, 0, 0, 0 );
 				SDL_RenderClear( gRenderer );
 
-				//Render game board
-				//gSpriteSheetTexture.render( 0, 0, &gBoard );
-				for (int i = 0; i < 31; i++)
-                {
-                    for (int j = 0; j < 28; j++)
-                    {
-                        //if tile has been crossed, use alt
-                        if (board.getTile(i, j).getCrossed())
-                        {
-                            gSpriteSheetTexture.render(j * 8, i *8, &gBoardPiecesAlt[i][j]);
-                        }
-                        else
-                        {
-                            gSpriteSheetTexture.render(j * 8, i *8, &gBoardPieces[i][j]);
-                        }
-                    }
-				}
-
-				//Render player
-				//offset sprite, x and y location refer to center of player
-				if (player.getDeathState())
-                {
-                    gSpriteSheetTexture.render(player.getXLoc() - 10, player.getYLoc() - 8, &gPlayerDeath[player.getDeathState()]);
-                }
-                else
-                {
-                    gSpriteSheetTexture.render(player.getXLoc() - 10, player.getYLoc() - 8, &gPlayer[player.currentSprite()]);
-                }
-
-                //render ghosts
-                if (blinky.getEaten())
-                {
-                    int c = blinky.getOrientation() + 4;
-                    gSpriteSheetTexture.render(blinky.getXLoc() - 10, blinky.getYLoc() - 8, &gMiscGhost[c]);
-                }
-                else if (blinky.getFlee())
-                {
-                    if (frame > fleeFrame + 420 && (frame / 20) % 2 == 0) //ghosts will blink near end of flee mode
-                    {
-                        gSpriteSheetTexture.render(blinky.getXLoc() - 10, blinky.getYLoc() - 8, &gMiscGhost[blinky.getMouthOpen() + 2]);
-                    }
-                    else
-                    {
-                        gSpriteSheetTexture.render(blinky.getXLoc() - 10, blinky.getYLoc() - 8, &gMiscGhost[blinky.getMouthOpen()]);
-                    }
-                }
-                else
-                {
-                    gSpriteSheetTexture.render(blinky.getXLoc() - 10, blinky.getYLoc() - 8, &gBlinky[blinky.currentSprite()]);
-                }
-                if (pinky.getEaten())
-                {
-                    int c = pinky.getOrientation() + 4;
-                    gSpriteSheetTexture.render(pinky.getXLoc() - 10, pinky.getYLoc() - 8, &gMiscGhost[c]);
-                }
-                else if (pinky.getFlee())
-                {
-                    if (frame > fleeFrame + 420 && (frame / 20) % 2 == 0) //ghosts will blink near end of flee mode
-                    {
-                        gSpriteSheetTexture.render(pinky.getXLoc() - 10, pinky.getYLoc() - 8, &gMiscGhost[pinky.getMouthOpen() + 2]);
-                    }
-                    else
-                    {
-                        gSpriteSheetTexture.render(pinky.getXLoc() - 10, pinky.getYLoc() - 8, &gMiscGhost[pinky.getMouthOpen()]);
-                    }
-                }
-                else
-                {
-                    gSpriteSheetTexture.render(pinky.getXLoc() - 10, pinky.getYLoc() - 8, &gPinky[pinky.currentSprite()]);
-                }
-                if (inky.getEaten())
-                {
-                    int c = inky.getOrientation() + 4;
-                    gSpriteSheetTexture.render(inky.getXLoc() - 10, inky.getYLoc() - 8, &gMiscGhost[c]);
-                }
-                else if (inky.getFlee())
-                {
-                    if (frame > fleeFrame + 420 && (frame / 20) % 2 == 0) //ghosts will blink near end of flee mode
-                    {
-                        gSpriteSheetTexture.render(inky.getXLoc() - 10, inky.getYLoc() - 8, &gMiscGhost[inky.getMouthOpen() + 2]);
-                    }
-                    else
-                    {
-                        gSpriteSheetTexture.render(inky.getXLoc() - 10, inky.getYLoc() - 8, &gMiscGhost[inky.getMouthOpen()]);
-                    }
-                }
-                else
-                {
-                    gSpriteSheetTexture.render(inky.getXLoc() - 10, inky.getYLoc() - 8, &gInky[inky.currentSprite()]);
-                }
-
-
-
-				//Update board
-				board.updateBoard(player);
-
-                //check if energizer is eaten
-                int xTile = (player.getXLoc() - 4) / 8;
-                int yTile = (player.getYLoc() - 4) / 8;
-                if (yTile == 3 && (xTile == 1 || xTile == 26))
-                {
-                    blinky.setFlee(true);
-                    pinky.setFlee(true);
-                    inky.setFlee(true);
-                    fleeFrame = frame;
-                }
-                else if (yTile == 23 && (xTile == 1 || xTile == 26))
-                {
-                    blinky.setFlee(true);
-                    pinky.setFlee(true);
-                    inky.setFlee(true);
-                    fleeFrame = frame;
-                }
-
-                //energizer expires after 10 seconds
-                if (fleeFrame != 0 && frame == fleeFrame + 600)
-                {
-                    blinky.setFlee(false);
-                    pinky.setFlee(false);
-                    inky.setFlee(false);
-                }
-
-				if (frame % 3 == 0)
-                {
-                    //checks if player is dead/dying
-                    if (player.getDeathState() || ((player.sharingTile(blinky) && !blinky.getEaten()) || (player.sharingTile(pinky) && !pinky.getEaten()) || (player.sharingTile(inky) && !inky.getEaten()) && !blinky.getFlee()))
-                    {
-                        player.kill();
-                        //ends game once death animation is over
-                        if (player.getDeathState() == 11)
-                        {
-                            quit = true;
-                        }
-                    }
-                    else
-                    {
-                        //Update player
-                        player.update(board);
-                    }
-				}
-
-				//checks if player has eaten ghosts
-				if (!player.getDeathState())
-                {
-                    if (blinky.getFlee() && player.sharingTile(blinky))
-                    {
-                        blinky.setEaten(true);
-                    }
-                    if (pinky.getFlee() && player.sharingTile(pinky))
-                    {
-                        pinky.setEaten(true);
-                    }
-                    if (inky.getFlee() && player.sharingTile(inky))
-                    {
-                        inky.setEaten(true);
-                    }
-                }
-
-                //update ghosts
-				if (frame % 4 == 0 && !player.getDeathState())
-                {
-                    if (frame % 1620 == 0)
-                    {
-                        blinky.setScatter(true);
-                        pinky.setScatter(true);
-                        inky.setScatter(true);
-                    }
-                    else if ((frame + 1200) % 1620 == 0)
-                    {
-                        blinky.setScatter(false);
-                        pinky.setScatter(false);
-                        inky.setScatter(false);
-                    }
-                    blinky.decideTurn(board, player);
-                    blinky.update(board);
-                    pinky.decideTurn(board, player);
-                    pinky.update(board);
-                    inky.decideTurn(board, player, blinky);
-                    inky.update(board);
-                }
-                frame++;
+				//Render board, player and ghosts part way to the next step
+				renderGame( view, previous, alpha );
+
+				//a frame composed on the CPU goes up in one upload
+				if( gSoftRenderer.isActive() )
+				{
+					PROFILE_SCOPE( PROFILE_PRESENT );
+					gSoftRenderer.present();
+				}
+
+				//Draw the profiler's bars on top
+				if( showProfile )
+				{
+					renderProfile();
+				}
 
 				//Update screen
-				SDL_RenderPresent( gRenderer );
+				{
+					PROFILE_SCOPE( PROFILE_PRESENT );
+					SDL_RenderPresent( gRenderer );
+				}
+				if( measureLatency )
+				{
+					latency.presented( SDL_GetPerformanceCounter() );
+				}
+
+				//Without vsync holding us back, sleep off the rest of the refresh period
+				Uint64 elapsed = SDL_GetPerformanceCounter() - frameStart;
+				if( elapsed < frameLength )
+				{
+					SDL_Delay( (Uint32)( ( frameLength - elapsed ) * 1000 / frequency ) );
+				}
+			}
+
+			//the game is ours again once the simulation thread is done with it
+			simulation.stop();
+
+			//state hash to check replays of this session against
+			if( recorder.isOpen() || replayPath != NULL )
+			{
+				printf( "stopped after %d frames, state %016llx\n", game.getFrame(), (unsigned long long)stateHash( game ) );
+			}
+			if( recorder.isOpen() && !recorder.close( game.getFrame() ) )
+			{
+				printf( "Recording %s is incomplete!\n", recordPath );
+			}
+
+			gProfiler.endFrame();
+			monitor.printSummary();
+			if( measureLatency )
+			{
+				latency.printSummary();
+			}
+			if( tracePath != NULL )
+			{
+				gProfiler.writeTrace( tracePath );
+			}
+			if( csvPath != NULL )
+			{
+				gProfiler.writeCSV( csvPath );
 			}
 		}
 	}
@@ -1771,4 +7950,4 @@ int main( int argc, char* args[] )
 	close();
 
 	return 0;
-}
+}